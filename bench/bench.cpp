@@ -0,0 +1,542 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "all_effects.h"
+#include "compositor.h"
+#include "cpu_dispatch.h"
+#include "frame_stats.h"
+#include "framebuffer.h"
+#include "palette_expand.h"
+#include "thread_pool.h"
+#include "upscale.h"
+
+/**
+ * The settings of a benchmark run
+ **/
+struct BenchOptions
+{
+  long frames = 200;                  // The number of measured frames per effect
+  long warmup = 5;                    // Frames calculated before the measurement starts
+  unsigned seed = 1;                  // The seed of the random number generator
+  std::string root = "..";            // The top directory of the repository, for the assets
+  std::string json;                   // Write the results also to this JSON file
+  std::vector<std::string> effects;   // The effects to measure, all of them if empty
+  int threads = 0;                    // Threads calculating the effects, 0 uses all the cores
+  bool kernels = false;               // Measure the presentation kernels instead of the effects
+  int width = 0;                      // The size of the screen, 0 uses the size the effect was written for
+  int height = 0;                     // (the kernels are measured at 3840x2160 then, the ones of the effects at half of it)
+};
+
+/**
+ * The measurements of one effect
+ **/
+struct BenchResult
+{
+  std::string name;
+  int width = 0;
+  int height = 0;
+  long frames = 0;
+  long restarts = 0;                  // How many times the effect has finished and was started again
+  double meanNs = 0;
+  double minNs = 0;
+  double maxNs = 0;
+  double p50Ns = 0;
+  double p99Ns = 0;
+  double p999Ns = 0;
+  double mpixelsPerSecond = 0;
+};
+
+/**
+ * Runs the update of the effect for the requested number of frames, measuring
+ * every frame separately. There is no presentation at all, only the kernel.
+ **/
+inline bool benchmarkEffect(const std::string& name, const BenchOptions& options, BenchResult& result)
+{
+  auto effect = makeEffect(name, options.root);
+  if (!effect)
+  {
+    std::cerr << "Unknown effect: " << name << std::endl;
+    return false;
+  }
+
+  srand(options.seed);
+  Framebuffer screen(options.width > 0 ? options.width : effect->width(),
+                     options.height > 0 ? options.height : effect->height());
+  if (!effect->resize(screen))
+  {
+    // Written for one size only, it is measured at that size
+    screen.resize(effect->width(), effect->height());
+    effect->resize(screen);
+  }
+  if (!effect->init(screen))
+  {
+    std::cerr << "Cannot initialize effect: " << name << std::endl;
+    return false;
+  }
+
+  result.name = name;
+  result.width = screen.width();
+  result.height = screen.height();
+
+  std::vector<double> samples;
+  samples.reserve(options.frames);
+
+  for (long frame = 0; frame < options.warmup + options.frames; frame++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    bool running = effect->update(screen);
+    auto end = std::chrono::steady_clock::now();
+
+    if (!running)
+    {
+      // Some effects (the scroller, the zoomer) come to an end, start them again
+      effect->init(screen);
+      result.restarts++;
+      frame--;
+      continue;
+    }
+
+    if (frame >= options.warmup)
+    {
+      samples.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+    }
+  }
+
+  double total = 0;
+  for (double s : samples) total += s;
+  std::sort(samples.begin(), samples.end());
+
+  result.frames = samples.size();
+  result.meanNs = samples.empty() ? 0 : total / samples.size();
+  result.minNs = samples.empty() ? 0 : samples.front();
+  result.maxNs = samples.empty() ? 0 : samples.back();
+  result.p50Ns = percentile(samples, 0.50);
+  result.p99Ns = percentile(samples, 0.99);
+  result.p999Ns = percentile(samples, 0.999);
+  result.mpixelsPerSecond = result.meanNs > 0 ? static_cast<double>(result.width) * result.height / result.meanNs * 1000.0 : 0;
+  return true;
+}
+
+/**
+ * The best time of the given number of runs of a kernel, in ns
+ **/
+template<class Kernel>
+inline double bestTime(long runs, Kernel kernel)
+{
+  double best = 1e30;
+  for (long i = 0; i < runs; i++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    kernel();
+    auto end = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count());
+  }
+  return best;
+}
+
+/**
+ * Measures one presentation kernel: the best of the given number of runs, in GB/s
+ * of destination memory written
+ **/
+template<class Kernel>
+inline double measureKernel(long runs, size_t bytes, Kernel kernel)
+{
+  return bytes / bestTime(runs, kernel);
+}
+
+/**
+ * The tiers the CPU supports which have a version of a kernel of their own:
+ * select(tier) gives the version a tier uses, the tiers using the same one as
+ * the tier below are left out
+ **/
+template<class Select>
+inline std::vector<CpuTier> kernelTiers(Select select)
+{
+  std::vector<CpuTier> tiers;
+  for (int i = CPU_SCALAR; i <= detectCpuTier(); i++)
+  {
+    CpuTier tier = static_cast<CpuTier>(i);
+    if (tiers.empty() || select(tier) != select(tiers.back())) tiers.push_back(tier);
+  }
+  return tiers;
+}
+
+/**
+ * Measures the upscaler enlarging a frame to the output size by 2, 3 and 4 times,
+ * with the kernels of every instruction set, and checks they give the same
+ * pixels as the scalar ones
+ **/
+inline bool benchmarkUpscale(const BenchOptions& options, const std::vector<uint8_t>& indices, const PaletteLut& lut, int width, int height)
+{
+  std::vector<CpuTier> tiers = kernelTiers([](CpuTier tier) { return selectUpscaleKernels(tier).widen; });
+
+  std::cout << "upscaling to " << width << "x" << height << ", GB/s written" << std::endl;
+  for (int factor = 2; factor <= MAX_UPSCALE; factor++)
+  {
+    Framebuffer screen(width / factor, height / factor);
+    for (int y = 0; y < screen.height(); y++)
+    {
+      memcpy(screen.row(y), indices.data() + static_cast<size_t>(y) * screen.width(), screen.width());
+    }
+    const int pitch = screen.width() * factor * static_cast<int>(sizeof(uint32_t));
+    const size_t bytes = static_cast<size_t>(pitch) * screen.height() * factor;
+
+    for (UpscaleFilter filter : {UPSCALE_NEAREST, UPSCALE_BILINEAR})
+    {
+      std::vector<uint8_t> expected(bytes), target(bytes);
+      Upscaler(UPSCALE_SCALAR).upscale(screen, lut, filter, factor, expected.data(), pitch);
+      for (CpuTier tier : tiers)
+      {
+        Upscaler upscaler(selectUpscaleKernels(tier));
+        double speed = measureKernel(options.frames, bytes, [&] { upscaler.upscale(screen, lut, filter, factor, target.data(), pitch); });
+        bool same = target == expected;
+        std::string name = std::string(filter == UPSCALE_NEAREST ? "nearest " : "bilinear ") + std::to_string(factor) + "x " + cpuTierName(tier);
+        std::cout << std::left << std::setw(20) << name << std::right << std::setw(6)
+                  << speed << " GB/s" << (same ? "" : "  MISMATCH") << std::endl;
+        if (!same) return false;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * Measures the compositor putting two layers over a screen: a band of text
+ * (colour keyed, a quarter of the rows) and a sparse additive layer. The scene
+ * is compared with the expansion of the three screens on their own, which is
+ * the least it can cost.
+ **/
+inline bool benchmarkCompositor(const BenchOptions& options, const std::vector<uint8_t>& indices, const PaletteLut& lut, int width, int height)
+{
+  Palette palette;
+  for (size_t i = 0; i < palette.size(); i++) palette[i] = Colour{uint8_t(rand()), uint8_t(rand()), uint8_t(rand()), 255};
+
+  Framebuffer screen(width, height), text(width, height), sparks(width, height);
+  for (int y = 0; y < height; y++)
+  {
+    const uint8_t* random = indices.data() + static_cast<size_t>(y) * width;
+    memcpy(screen.row(y), random, width);
+    for (int x = 0; x < width; x++)
+    {
+      text.row(y)[x] = y >= height * 3 / 8 && y < height * 5 / 8 && random[x] < 128 ? random[x] : 0;
+      sparks.row(y)[x] = random[x] < 16 ? random[x] : 0;
+    }
+  }
+
+  std::vector<Layer> layers(2);
+  layers[0].screen = &text;
+  layers[0].palette = &palette;
+  layers[1].screen = &sparks;
+  layers[1].palette = &palette;
+  layers[1].mode = BLEND_ADDITIVE;
+
+  const size_t bytes = static_cast<size_t>(width) * height * sizeof(uint32_t);
+  const int pitch = width * static_cast<int>(sizeof(uint32_t));
+  std::vector<uint8_t> expected(bytes), target(bytes);
+  Compositor(COMPOSITE_SCALAR).composite(screen, palette, layers, expected.data(), pitch);
+
+  double alone = bestTime(options.frames, [&] {
+    for (const Framebuffer* layer : {&screen, &text, &sparks})
+    {
+      for (int y = 0; y < height; y++)
+      {
+        expandPalette(layer->row(y), reinterpret_cast<uint32_t*>(target.data() + static_cast<size_t>(y) * pitch), width, lut);
+      }
+    }
+  });
+  std::cout << "compositing 2 layers at " << width << "x" << height << ", the 3 screens expanded alone: " << alone / 1e6 << " ms" << std::endl;
+
+  for (CpuTier tier : kernelTiers([](CpuTier tier) { return selectCompositeKernels(tier).cover; }))
+  {
+    Compositor compositor(selectCompositeKernels(tier));
+    double ms = bestTime(options.frames, [&] { compositor.composite(screen, palette, layers, target.data(), pitch); }) / 1e6;
+    bool same = target == expected;
+    std::cout << std::left << std::setw(20) << (std::string("composite ") + cpuTierName(tier)) << std::right << std::setw(8)
+              << ms << " ms" << std::setw(8) << ms / (alone / 1e6) << "x" << (same ? "" : "  MISMATCH") << std::endl;
+    if (!same) return false;
+  }
+  return true;
+}
+
+/**
+ * Measures the versions of a kernel of the effects, in ms per frame: run(tier,
+ * output) calculates a frame with the version of the tier, which has to give
+ * the same output as the scalar one. A frame of these takes up to a second, so
+ * they get at most EFFECT_KERNEL_RUNS runs.
+ **/
+const long EFFECT_KERNEL_RUNS = 20;
+
+template<class Select, class Run>
+inline bool benchmarkTiers(const char* name, const BenchOptions& options, Select select, Run run)
+{
+  std::vector<uint8_t> expected, output;
+  run(CPU_SCALAR, expected);
+  for (CpuTier tier : kernelTiers(select))
+  {
+    double ms = bestTime(std::min(options.frames, EFFECT_KERNEL_RUNS), [&] { run(tier, output); }) / 1e6;
+    bool same = output == expected;
+    std::cout << std::left << std::setw(24) << (std::string(name) + " " + cpuTierName(tier)) << std::right << std::setw(10)
+              << ms << " ms" << (same ? "" : "  MISMATCH") << std::endl;
+    if (!same) return false;
+  }
+  return true;
+}
+
+/**
+ * Measures the dispatched kernels of the effects (the random bits of the fires,
+ * the water, the rotozoomer and the Mandelbrot set) on a frame of the given size
+ **/
+inline bool benchmarkEffectKernels(const BenchOptions& options, int width, int height)
+{
+  const size_t cells = static_cast<size_t>(width) * height;
+  std::cout << "effect kernels, " << width << "x" << height << ", best of " << std::min(options.frames, EFFECT_KERNEL_RUNS) << " runs" << std::endl;
+
+  // The random bits of the fire, a column at a time
+  bool same = benchmarkTiers("random bits", options, [](CpuTier tier) { return selectPhiloxColumn(tier); },
+    [&](CpuTier tier, std::vector<uint8_t>& output) {
+      PhiloxColumnFunction column = selectPhiloxColumn(tier);
+      output.resize(cells * sizeof(RandomBits));
+      RandomBits* bits = reinterpret_cast<RandomBits*>(output.data());
+      for (int x = 0; x < width; x++)
+      {
+        column(1, x, 0, 0, 0x12345678, 0x9abcdef0, height, bits + static_cast<size_t>(x) * height);
+      }
+    });
+
+  // Ten steps of the water from the same random height map, each of them on every row
+  std::vector<int> heights(2 * cells);
+  for (auto& h : heights) h = rand() % 4096 - 2048;
+  same = same && benchmarkTiers("ripple", options, [](CpuTier tier) { return selectRippleKernels(tier).ripple; },
+    [&](CpuTier tier, std::vector<uint8_t>& output) {
+      RippleKernels kernels = selectRippleKernels(tier);
+      std::vector<int> pages = heights;
+      for (int step = 0; step < 10; step++)
+      {
+        int* newPage = pages.data() + (step % 2) * cells;
+        const int* oldPage = pages.data() + (1 - step % 2) * cells;
+        for (int y = 1; y < height - 1; y++)
+        {
+          kernels.ripple(newPage + y * width, oldPage + y * width, width, 128);
+        }
+      }
+      output.assign(reinterpret_cast<const uint8_t*>(pages.data()), reinterpret_cast<const uint8_t*>(pages.data() + pages.size()));
+    });
+
+  std::vector<uint8_t> texture(rotozoom::TEXTURE_SIZE_X * rotozoom::TEXTURE_SIZE_Y);
+  for (auto& t : texture) t = rand() % 256;
+  same = same && benchmarkTiers("rotozoom", options, [](CpuTier tier) { return rotozoom::selectRotozoomSpan(tier); },
+    [&](CpuTier tier, std::vector<uint8_t>& output) {
+      rotozoom::RotozoomSpanFunction span = rotozoom::selectRotozoomSpan(tier);
+      rotozoom::RotozoomView view{texture.data(), sin(0.7), cos(0.7), 1.3};
+      output.resize(cells);
+      for (int y = 0; y < height; y++)
+      {
+        span(output.data() + static_cast<size_t>(y) * width, y, 0, width, view);
+      }
+    });
+
+  same = same && benchmarkTiers("mandelbrot", options, [](CpuTier tier) { return mandelzoom::selectMandelbrotRow(tier); },
+    [&](CpuTier tier, std::vector<uint8_t>& output) {
+      mandelzoom::MandelbrotRowFunction iterate = mandelzoom::selectMandelbrotRow(tier);
+      const double zoomFactor = 4;
+      output.resize(cells);
+      for (int y = 0; y < height; y++)
+      {
+        mandelzoom::MandelbrotRow where{static_cast<double>(width / 2), zoomFactor * width, mandelzoom::centerX,
+                            (static_cast<double>(y) - height / 2) / (zoomFactor * height) + mandelzoom::centerY,
+                            mandelzoom::MANDELBROT_THRESHOLD, mandelzoom::MANDELBROT_MAX_ITERATIONS};
+        iterate(output.data() + static_cast<size_t>(y) * width, 0, width, where);
+      }
+    });
+  return same;
+}
+
+/**
+ * Compares the palette expansion implementations with a plain memcpy writing
+ * the same amount of memory
+ **/
+inline bool benchmarkKernels(const BenchOptions& options)
+{
+  const int width = options.width > 0 ? options.width : 3840;
+  const int height = options.height > 0 ? options.height : 2160;
+  const size_t pixels = static_cast<size_t>(width) * height;
+  std::vector<uint8_t> indices(pixels);
+  std::vector<uint32_t> expected(pixels);
+  std::vector<uint32_t> target(pixels);
+  std::vector<uint32_t> source(pixels);
+
+  srand(options.seed);
+  for (auto& i : indices) i = rand() % 256;
+
+  Palette palette;
+  for (size_t i = 0; i < palette.size(); i++) palette[i] = Colour{uint8_t(rand()), uint8_t(rand()), uint8_t(rand()), 255};
+  PaletteLut lut;
+  buildPaletteLut(palette, lut);
+  expandPaletteScalar(indices.data(), expected.data(), pixels, lut, false);
+
+  const size_t bytes = pixels * sizeof(uint32_t);
+  std::cout << "cpu: " << cpuTierName(detectCpuTier()) << ", kernels in use: " << cpuTierName(cpuTier()) << std::endl;
+  std::cout << "palette expansion, " << width << "x" << height << ", best of " << options.frames << " runs" << std::endl;
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << std::left << std::setw(16) << "memcpy" << std::right << std::setw(10)
+            << measureKernel(options.frames, bytes, [&] { memcpy(target.data(), source.data(), bytes); }) << " GB/s" << std::endl;
+
+  // Row by row, as the presenter expands the frames into the texture, with plain and non-temporal stores
+  const bool stream = streamFrame(bytes);
+  for (CpuTier tier : kernelTiers([](CpuTier tier) { return selectExpandPalette(tier); }))
+  {
+    ExpandPaletteFunction expand = selectExpandPalette(tier);
+    for (bool streamed : {false, true})
+    {
+      double speed = measureKernel(options.frames, bytes, [&] {
+        for (int y = 0; y < height; y++)
+        {
+          const size_t offset = static_cast<size_t>(y) * width;
+          expand(indices.data() + offset, target.data() + offset, width, lut, streamed);
+        }
+      });
+      bool same = memcmp(target.data(), expected.data(), bytes) == 0;
+      std::cout << std::left << std::setw(16) << (std::string("expand ") + cpuTierName(tier)) << std::right << std::setw(10)
+                << speed << " GB/s" << (streamed ? ", streamed" : "") << (streamed == stream || tier == CPU_SCALAR ? "  (presenter)" : "")
+                << (same ? "" : "  MISMATCH") << std::endl;
+      if (!same) return false;
+      if (tier == CPU_SCALAR) break;    // the scalar version has no non-temporal stores
+    }
+  }
+
+  return benchmarkUpscale(options, indices, lut, width, height) &&
+         benchmarkCompositor(options, indices, lut, width, height) &&
+         benchmarkEffectKernels(options, width / 2, height / 2);
+}
+
+inline void printText(const std::vector<BenchResult>& results, const BenchOptions& options)
+{
+  std::cout << "frames: " << options.frames << ", warmup: " << options.warmup << ", seed: " << options.seed
+            << ", threads: " << defaultThreadPool().threadCount() << std::endl;
+  std::cout << std::left << std::setw(16) << "effect" << std::right
+            << std::setw(11) << "size"
+            << std::setw(14) << "ns/frame"
+            << std::setw(13) << "Mpixel/s"
+            << std::setw(14) << "p50 ns"
+            << std::setw(14) << "p99 ns"
+            << std::setw(14) << "p99.9 ns" << std::endl;
+
+  for (const auto& r : results)
+  {
+    std::cout << std::left << std::setw(16) << r.name << std::right
+              << std::setw(11) << (std::to_string(r.width) + "x" + std::to_string(r.height))
+              << std::fixed << std::setprecision(0)
+              << std::setw(14) << r.meanNs
+              << std::setprecision(2)
+              << std::setw(13) << r.mpixelsPerSecond
+              << std::setprecision(0)
+              << std::setw(14) << r.p50Ns
+              << std::setw(14) << r.p99Ns
+              << std::setw(14) << r.p999Ns << std::endl;
+  }
+}
+
+inline bool writeJson(const std::vector<BenchResult>& results, const BenchOptions& options)
+{
+  std::ofstream out(options.json);
+  if (!out.is_open())
+  {
+    std::cerr << "Error opening file for writing: " << options.json << std::endl;
+    return false;
+  }
+
+  out << std::fixed << std::setprecision(1);
+  out << "{\n  \"frames\": " << options.frames << ",\n  \"warmup\": " << options.warmup
+      << ",\n  \"seed\": " << options.seed << ",\n  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const auto& r = results[i];
+    out << "    {\"effect\": \"" << r.name << "\", \"width\": " << r.width << ", \"height\": " << r.height
+        << ", \"frames\": " << r.frames << ", \"restarts\": " << r.restarts
+        << ", \"ns_per_frame\": " << r.meanNs << ", \"min_ns\": " << r.minNs << ", \"max_ns\": " << r.maxNs
+        << ", \"p50_ns\": " << r.p50Ns << ", \"p99_ns\": " << r.p99Ns << ", \"p999_ns\": " << r.p999Ns
+        << ", \"mpixel_per_s\": " << std::setprecision(3) << r.mpixelsPerSecond << std::setprecision(1) << "}"
+        << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n}\n";
+  return true;
+}
+
+inline bool parseBenchOptions(int argc, char* argv[], BenchOptions& options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--frames" && i + 1 < argc) options.frames = std::atol(argv[++i]);
+    else if (arg == "--warmup" && i + 1 < argc) options.warmup = std::atol(argv[++i]);
+    else if (arg == "--seed" && i + 1 < argc) options.seed = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    else if (arg == "--root" && i + 1 < argc) options.root = argv[++i];
+    else if (arg == "--json" && i + 1 < argc) options.json = argv[++i];
+    else if (arg == "--effect" && i + 1 < argc) options.effects.push_back(argv[++i]);
+    else if (arg == "--kernels") options.kernels = true;
+    else if (arg == "--threads" && i + 1 < argc) options.threads = std::atoi(argv[++i]);
+    else if (arg == "--width" && i + 1 < argc) options.width = std::atoi(argv[++i]);
+    else if (arg == "--height" && i + 1 < argc) options.height = std::atoi(argv[++i]);
+    else
+    {
+      std::cerr << "Usage: " << argv[0] << " [--frames N] [--warmup N] [--seed N] [--root DIR] [--json FILE] [--threads N] [--width W] [--height H] [--effect NAME]..." << std::endl;
+      std::cerr << "       " << argv[0] << " --kernels [--frames N] [--width W] [--height H]" << std::endl;
+      std::cerr << "Effects:";
+      for (const auto& name : effectNames()) std::cerr << " " << name;
+      std::cerr << std::endl;
+      return false;
+    }
+  }
+
+  if (options.effects.empty())
+  {
+    options.effects = effectNames();
+  }
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  BenchOptions options;
+  if (!parseBenchOptions(argc, argv, options))
+  {
+    return EXIT_FAILURE;
+  }
+
+  if (options.threads > 0)
+  {
+    setThreadCount(options.threads);
+  }
+
+  if (options.kernels)
+  {
+    return benchmarkKernels(options) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  std::vector<BenchResult> results;
+  for (const auto& name : options.effects)
+  {
+    BenchResult result;
+    if (!benchmarkEffect(name, options, result))
+    {
+      return EXIT_FAILURE;
+    }
+    results.push_back(result);
+  }
+
+  printText(results, options);
+
+  if (!options.json.empty() && !writeJson(results, options))
+  {
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
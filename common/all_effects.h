@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "effect.h"
+#include "layered_effect.h"
+
+#include "../part1/cloud_plasma/cloud_plasma.h"
+#include "../part1/colour_cycling/colour_cycling.h"
+#include "../part2/conway/conway_fire.h"
+#include "../part2/fire/fire.h"
+#include "../part2/scroll/swscroll.h"
+#include "../part3/mandelzoom/mandelzoom.h"
+#include "../part3/rotozoom/rotozoom.h"
+#include "../part3/tunnel/tunnel.h"
+#include "../part4/rain/rain.h"
+#include "../part4/water/water.h"
+
+/**
+ * The short names of all the effects of the series, in the order of the articles
+ **/
+inline std::vector<std::string> effectNames()
+{
+  return {"cloud_plasma", "colour_cycling", "fire", "conway_fire", "swscroll",
+          "mandelzoom", "rotozoom", "tunnel", "water", "rain"};
+}
+
+inline std::unique_ptr<Effect> makeLayeredEffect(const std::string& name, const std::string& root);
+
+/**
+ * Creates the effect with the given short name. The assets are looked up relative
+ * to root, which should be the top directory of the repository. Returns nullptr
+ * for an unknown name. Effects drawn over each other are named with a +, see
+ * makeLayeredEffect().
+ **/
+inline std::unique_ptr<Effect> makeEffect(const std::string& name, const std::string& root = "..")
+{
+  if (name.find('+') != std::string::npos) return makeLayeredEffect(name, root);
+  if (name == "cloud_plasma") return std::make_unique<cloud_plasma::CloudPlasmaEffect>();
+  if (name == "colour_cycling") return std::make_unique<colour_cycling::ColourCyclingEffect>();
+  if (name == "fire") return std::make_unique<fire::FireEffect>();
+  if (name == "conway_fire") return std::make_unique<conway::ConwayFireEffect>();
+  if (name == "swscroll") return std::make_unique<swscroll::StarWarsScrollEffect>(root + "/part2/scroll/output_image.custom");
+  if (name == "mandelzoom") return std::make_unique<mandelzoom::MandelzoomEffect>();
+  if (name == "rotozoom") return std::make_unique<rotozoom::RotozoomEffect>(root + "/part3/rotozoom/output_image.custom");
+  if (name == "tunnel") return std::make_unique<tunnel::TunnelEffect>(root + "/part3/tunnel/output_image.custom");
+  if (name == "water") return std::make_unique<water::WaterEffect>();
+  if (name == "rain") return std::make_unique<rain::RainEffect>(root + "/part4/rain/output_image.custom");
+  return nullptr;
+}
+
+/**
+ * Creates the effects of a name like "tunnel+swscroll" or "cloud_plasma+fire:add",
+ * drawn over each other from the left to the right (see LayeredEffect). The
+ * effects after the first one can say how they are blended over the ones below:
+ * ":key" (the default) shows all but their transparent colours, ":add" adds the
+ * colours and ":alpha" mixes them half and half. Returns nullptr if one of the
+ * effects or of the modes is unknown.
+ **/
+inline std::unique_ptr<Effect> makeLayeredEffect(const std::string& name, const std::string& root)
+{
+  std::vector<std::string> names;
+  for (size_t start = 0, end; start <= name.size(); start = end + 1)
+  {
+    end = std::min(name.find('+', start), name.size());
+    names.push_back(name.substr(start, end - start));
+  }
+
+  std::unique_ptr<Effect> base = makeEffect(names[0], root);
+  if (!base) return nullptr;
+
+  std::vector<std::pair<std::unique_ptr<Effect>, LayerSettings>> layered;
+  for (size_t i = 1; i < names.size(); i++)
+  {
+    size_t colon = names[i].find(':');
+    std::string mode = colon == std::string::npos ? "key" : names[i].substr(colon + 1);
+    LayerSettings settings;
+    if (mode == "add") settings.mode = BLEND_ADDITIVE;
+    else if (mode == "alpha") { settings.mode = BLEND_ALPHA; settings.alpha = 128; }
+    else if (mode != "key") return nullptr;
+
+    std::unique_ptr<Effect> effect = makeEffect(names[i].substr(0, colon), root);
+    if (!effect) return nullptr;
+    layered.emplace_back(std::move(effect), settings);
+  }
+  return std::make_unique<LayeredEffect>(std::move(base), std::move(layered));
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+/**
+ * A run of elements allocated from an Arena. It does not own them, they are valid
+ * until the arena is reset (or destroyed), so it is copied around like a pointer.
+ **/
+template<class T>
+class ArenaArray
+{
+public:
+  ArenaArray() = default;
+  ArenaArray(T* data, size_t size) : elements(data), count(size) {}
+
+  T* data() const { return elements; }
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  T& operator[](size_t index) const { return elements[index]; }
+  T* begin() const { return elements; }
+  T* end() const { return elements + count; }
+
+private:
+  T* elements = nullptr;
+  size_t count = 0;
+};
+
+/**
+ * The memory of the buffers of an effect (height maps, scaled images, scratch
+ * rows and the like) in one region, instead of scattered all over the heap.
+ * Allocating moves a pointer forward, and reset() gives back everything at once,
+ * so the buffers are allocated again on every resize without going to the heap,
+ * and never within a frame.
+ *
+ * The regions are mapped with transparent huge pages where the system has them
+ * (unless useHugePages(false) was called), so the per-pixel tables of a large
+ * screen need a few TLB entries instead of thousands. When an arena is destroyed
+ * its region is kept for the next one: the effects of a demo take over the
+ * memory, already mapped, of the ones before them.
+ *
+ * Only types which need no constructor or destructor can be allocated.
+ **/
+class Arena
+{
+public:
+  static constexpr size_t ALIGNMENT = 64;             // Every allocation starts on a cache line
+  static constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+  static constexpr size_t MIN_REGION_SIZE = HUGE_PAGE_SIZE;
+  static const int CACHED_REGIONS = 2;                // Regions kept after their arena is destroyed
+
+  Arena() = default;
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  ~Arena()
+  {
+    releaseRegions();
+  }
+
+  /**
+   * Allocates count elements, all set to value
+   **/
+  template<class T>
+  ArenaArray<T> allocate(size_t count, T value = T())
+  {
+    static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value,
+                  "Only plain types can be allocated from an arena");
+    static_assert(alignof(T) <= ALIGNMENT, "The arena cannot align the type");
+
+    T* data = static_cast<T*>(allocateBytes(count * sizeof(T)));
+    std::fill(data, data + count, value);
+    return ArenaArray<T>(data, count);
+  }
+
+  // Allocates the given number of bytes, uninitialized
+  void* allocateBytes(size_t bytes)
+  {
+    bytes = (std::max<size_t>(bytes, 1) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if (regions.empty() || offset + bytes > regions.back().size)
+    {
+      regions.push_back(acquireRegion(std::max(bytes, std::max(MIN_REGION_SIZE, 2 * capacity()))));
+      offset = 0;
+    }
+
+    void* memory = regions.back().memory + offset;
+    offset += bytes;
+    used += bytes;
+    highWater = std::max(highWater, used);
+    return memory;
+  }
+
+  /**
+   * Gives back everything allocated so far. If the arena has outgrown its first
+   * region, the regions are replaced by one large enough for all that was in
+   * them, otherwise nothing but the offset changes.
+   **/
+  void reset()
+  {
+    if (regions.size() > 1)
+    {
+      releaseRegions();
+      regions.push_back(acquireRegion(highWater));
+    }
+    offset = 0;
+    used = 0;
+  }
+
+  /**
+   * Makes sure that the next allocations, up to the given number of bytes, come
+   * from the same region. The effects knowing how much they need after a resize
+   * call it right after reset(), so their tables are not spread over regions.
+   **/
+  void reserve(size_t bytes)
+  {
+    size_t available = regions.empty() ? 0 : regions.back().size - offset;
+    if (bytes <= available) return;
+
+    if (used == 0)
+    {
+      releaseRegions();
+    }
+    regions.push_back(acquireRegion(std::max(bytes, MIN_REGION_SIZE)));
+    offset = 0;
+    highWater = std::max(highWater, used + bytes);
+  }
+
+  // The bytes allocated since the last reset, and the ones which can be without growing
+  size_t bytesUsed() const { return used; }
+
+  size_t capacity() const
+  {
+    size_t total = 0;
+    for (const Region& region : regions)
+    {
+      total += region.size;
+    }
+    return total;
+  }
+
+  // Whether the regions mapped from now on are backed by huge pages
+  static void useHugePages(bool enabled)
+  {
+    hugePagesEnabled().store(enabled, std::memory_order_relaxed);
+  }
+
+private:
+  struct Region
+  {
+    uint8_t* memory;
+    size_t size;
+  };
+
+  static std::atomic<bool>& hugePagesEnabled()
+  {
+    static std::atomic<bool> enabled(true);
+    return enabled;
+  }
+
+  static std::mutex& cacheMutex()
+  {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  static std::vector<Region>& cachedRegions()
+  {
+    static std::vector<Region> regions;
+    return regions;
+  }
+
+  // The smallest region kept from an arena before which is large enough, or a new one
+  static Region acquireRegion(size_t size)
+  {
+    {
+      std::lock_guard<std::mutex> lock(cacheMutex());
+      std::vector<Region>& cache = cachedRegions();
+      auto best = cache.end();
+      for (auto region = cache.begin(); region != cache.end(); ++region)
+      {
+        if (region->size >= size && (best == cache.end() || region->size < best->size)) best = region;
+      }
+      if (best != cache.end())
+      {
+        Region region = *best;
+        cache.erase(best);
+        return region;
+      }
+    }
+    return mapRegion(size);
+  }
+
+  // Keeps the region for the next arena, unmapping the smallest one if too many are kept
+  static void cacheRegion(Region region)
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex());
+    std::vector<Region>& cache = cachedRegions();
+    cache.push_back(region);
+    if (static_cast<int>(cache.size()) > CACHED_REGIONS)
+    {
+      auto smallest = std::min_element(cache.begin(), cache.end(), [](const Region& a, const Region& b) { return a.size < b.size; });
+      unmapRegion(*smallest);
+      cache.erase(smallest);
+    }
+  }
+
+  void releaseRegions()
+  {
+    // The largest region is the one worth keeping, the others only held the overflow
+    std::sort(regions.begin(), regions.end(), [](const Region& a, const Region& b) { return a.size > b.size; });
+    for (size_t i = 0; i < regions.size(); i++)
+    {
+      if (i == 0) cacheRegion(regions[i]);
+      else unmapRegion(regions[i]);
+    }
+    regions.clear();
+  }
+
+#ifdef __linux__
+  static Region mapRegion(size_t size)
+  {
+    // Huge pages have to be aligned to their size, so a page more is mapped and the ends trimmed
+    bool huge = hugePagesEnabled().load(std::memory_order_relaxed) && size >= HUGE_PAGE_SIZE;
+    size_t alignment = huge ? HUGE_PAGE_SIZE : 4096;
+    size = (size + alignment - 1) / alignment * alignment;
+    size_t mapped = huge ? size + HUGE_PAGE_SIZE : size;
+
+    void* memory = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+      throw std::bad_alloc();
+    }
+
+    uint8_t* start = static_cast<uint8_t*>(memory);
+    if (huge)
+    {
+      uint8_t* aligned = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(start) + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+      if (aligned > start) munmap(start, aligned - start);
+      if (aligned + size < start + mapped) munmap(aligned + size, start + mapped - (aligned + size));
+      start = aligned;
+#ifdef MADV_HUGEPAGE
+      madvise(start, size, MADV_HUGEPAGE);
+#endif
+    }
+    return Region{start, size};
+  }
+
+  static void unmapRegion(const Region& region)
+  {
+    munmap(region.memory, region.size);
+  }
+#else
+  static Region mapRegion(size_t size)
+  {
+    size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    return Region{static_cast<uint8_t*>(::operator new(size, std::align_val_t(ALIGNMENT))), size};
+  }
+
+  static void unmapRegion(const Region& region)
+  {
+    ::operator delete(region.memory, std::align_val_t(ALIGNMENT));
+  }
+#endif
+
+  std::vector<Region> regions;    // The last one is the one allocated from
+  size_t offset = 0;              // The first free byte of the last region
+  size_t used = 0;
+  size_t highWater = 0;           // The most bytes ever allocated between two resets
+};
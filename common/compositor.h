@@ -0,0 +1,388 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "cpu_dispatch.h"
+#include "effect.h"
+#include "framebuffer.h"
+#include "palette_expand.h"
+
+// The pixels of a row of a layer are looked at in blocks of this many for transparency
+const int COVERAGE_BLOCK = 32;
+
+/**
+ * Sets the bit b of the mask for every block b of the row (of blocks blocks)
+ * having a pixel of another colour than the key. The last block can go past
+ * the end of the row into the guard band, which at most sets a bit for nothing.
+ **/
+typedef void (*CoverRowFunction)(const uint8_t* row, int blocks, uint8_t key, uint64_t* mask);
+
+/**
+ * Blends count pixels of a layer, expanded to ARGB, over the pixels in dst. The
+ * pixels of the transparent colours were expanded with an alpha of 0, they are
+ * left out. weight is the opacity for the alpha blending, 0 to 256.
+ **/
+typedef void (*BlendRowFunction)(const uint32_t* colours, uint32_t* dst, int count, int weight);
+
+inline void coverRowScalar(const uint8_t* row, int blocks, uint8_t key, uint64_t* mask)
+{
+  std::fill(mask, mask + (blocks + 63) / 64, 0);
+  for (int b = 0; b < blocks; b++)
+  {
+    const uint8_t* block = row + b * COVERAGE_BLOCK;
+    for (int x = 0; x < COVERAGE_BLOCK; x++)
+    {
+      if (block[x] != key)
+      {
+        mask[b / 64] |= uint64_t(1) << (b % 64);
+        break;
+      }
+    }
+  }
+}
+
+inline void keyRowScalar(const uint32_t* colours, uint32_t* dst, int count, int)
+{
+  for (int x = 0; x < count; x++)
+  {
+    if (colours[x] >> 24) dst[x] = colours[x];
+  }
+}
+
+inline void addRowScalar(const uint32_t* colours, uint32_t* dst, int count, int)
+{
+  for (int x = 0; x < count; x++)
+  {
+    if (!(colours[x] >> 24)) continue;
+    uint32_t sum = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+      uint32_t channel = ((colours[x] >> shift) & 0xFF) + ((dst[x] >> shift) & 0xFF);
+      sum |= std::min<uint32_t>(channel, 0xFF) << shift;
+    }
+    dst[x] = sum;
+  }
+}
+
+inline void alphaRowScalar(const uint32_t* colours, uint32_t* dst, int count, int weight)
+{
+  for (int x = 0; x < count; x++)
+  {
+    if (!(colours[x] >> 24)) continue;
+    uint32_t mixed = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+      uint32_t channel = ((colours[x] >> shift) & 0xFF) * weight + ((dst[x] >> shift) & 0xFF) * (256 - weight);
+      mixed |= (channel >> 8) << shift;
+    }
+    dst[x] = mixed;
+  }
+}
+
+#ifdef LXF_X86
+
+inline void coverRowSse2(const uint8_t* row, int blocks, uint8_t key, uint64_t* mask)
+{
+  const __m128i keys = _mm_set1_epi8(static_cast<char>(key));
+  std::fill(mask, mask + (blocks + 63) / 64, 0);
+  for (int b = 0; b < blocks; b++)
+  {
+    const __m128i* block = reinterpret_cast<const __m128i*>(row + b * COVERAGE_BLOCK);
+    __m128i transparent = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(block), keys), _mm_cmpeq_epi8(_mm_loadu_si128(block + 1), keys));
+    if (_mm_movemask_epi8(transparent) != 0xFFFF)
+    {
+      mask[b / 64] |= uint64_t(1) << (b % 64);
+    }
+  }
+}
+
+// All the bits set in the pixels expanded with an alpha of 0, the transparent ones
+inline __m128i transparentSse2(__m128i colours)
+{
+  return _mm_cmpeq_epi32(_mm_srli_epi32(colours, 24), _mm_setzero_si128());
+}
+
+inline __m128i selectSse2(__m128i transparent, __m128i below, __m128i above)
+{
+  return _mm_or_si128(_mm_and_si128(transparent, below), _mm_andnot_si128(transparent, above));
+}
+
+inline void keyRowSse2(const uint32_t* colours, uint32_t* dst, int count, int weight)
+{
+  int x = 0;
+  for (; x + 4 <= count; x += 4)
+  {
+    __m128i* below = reinterpret_cast<__m128i*>(dst + x);
+    __m128i above = _mm_loadu_si128(reinterpret_cast<const __m128i*>(colours + x));
+    _mm_storeu_si128(below, selectSse2(transparentSse2(above), _mm_loadu_si128(below), above));
+  }
+  keyRowScalar(colours + x, dst + x, count - x, weight);
+}
+
+inline void addRowSse2(const uint32_t* colours, uint32_t* dst, int count, int weight)
+{
+  int x = 0;
+  for (; x + 4 <= count; x += 4)
+  {
+    __m128i* below = reinterpret_cast<__m128i*>(dst + x);
+    __m128i above = _mm_loadu_si128(reinterpret_cast<const __m128i*>(colours + x));
+    __m128i pixels = _mm_loadu_si128(below);
+    _mm_storeu_si128(below, selectSse2(transparentSse2(above), pixels, _mm_adds_epu8(pixels, above)));
+  }
+  addRowScalar(colours + x, dst + x, count - x, weight);
+}
+
+// (above * weight + below * (256 - weight)) >> 8 per channel, in 16 bit lanes
+inline __m128i mixSse2(__m128i below, __m128i above, __m128i weights, __m128i inverse)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(above, zero), weights), _mm_mullo_epi16(_mm_unpacklo_epi8(below, zero), inverse));
+  __m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(above, zero), weights), _mm_mullo_epi16(_mm_unpackhi_epi8(below, zero), inverse));
+  return _mm_packus_epi16(_mm_srli_epi16(low, 8), _mm_srli_epi16(high, 8));
+}
+
+inline void alphaRowSse2(const uint32_t* colours, uint32_t* dst, int count, int weight)
+{
+  const __m128i weights = _mm_set1_epi16(static_cast<short>(weight));
+  const __m128i inverse = _mm_set1_epi16(static_cast<short>(256 - weight));
+  int x = 0;
+  for (; x + 4 <= count; x += 4)
+  {
+    __m128i* below = reinterpret_cast<__m128i*>(dst + x);
+    __m128i above = _mm_loadu_si128(reinterpret_cast<const __m128i*>(colours + x));
+    __m128i pixels = _mm_loadu_si128(below);
+    _mm_storeu_si128(below, selectSse2(transparentSse2(above), pixels, mixSse2(pixels, above, weights, inverse)));
+  }
+  alphaRowScalar(colours + x, dst + x, count - x, weight);
+}
+
+__attribute__((target("avx2")))
+inline void coverRowAvx2(const uint8_t* row, int blocks, uint8_t key, uint64_t* mask)
+{
+  const __m256i keys = _mm256_set1_epi8(static_cast<char>(key));
+  std::fill(mask, mask + (blocks + 63) / 64, 0);
+  for (int b = 0; b < blocks; b++)
+  {
+    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + b * COVERAGE_BLOCK));
+    if (static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, keys))) != 0xFFFFFFFFu)
+    {
+      mask[b / 64] |= uint64_t(1) << (b % 64);
+    }
+  }
+}
+
+__attribute__((target("avx2")))
+inline __m256i transparentAvx2(__m256i colours)
+{
+  return _mm256_cmpeq_epi32(_mm256_srli_epi32(colours, 24), _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+inline void keyRowAvx2(const uint32_t* colours, uint32_t* dst, int count, int weight)
+{
+  int x = 0;
+  for (; x + 8 <= count; x += 8)
+  {
+    __m256i* below = reinterpret_cast<__m256i*>(dst + x);
+    __m256i above = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(colours + x));
+    _mm256_storeu_si256(below, _mm256_blendv_epi8(above, _mm256_loadu_si256(below), transparentAvx2(above)));
+  }
+  keyRowScalar(colours + x, dst + x, count - x, weight);
+}
+
+__attribute__((target("avx2")))
+inline void addRowAvx2(const uint32_t* colours, uint32_t* dst, int count, int weight)
+{
+  int x = 0;
+  for (; x + 8 <= count; x += 8)
+  {
+    __m256i* below = reinterpret_cast<__m256i*>(dst + x);
+    __m256i above = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(colours + x));
+    __m256i pixels = _mm256_loadu_si256(below);
+    _mm256_storeu_si256(below, _mm256_blendv_epi8(_mm256_adds_epu8(pixels, above), pixels, transparentAvx2(above)));
+  }
+  addRowScalar(colours + x, dst + x, count - x, weight);
+}
+
+__attribute__((target("avx2")))
+inline __m256i mixAvx2(__m256i below, __m256i above, __m256i weights, __m256i inverse)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i low = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(above, zero), weights), _mm256_mullo_epi16(_mm256_unpacklo_epi8(below, zero), inverse));
+  __m256i high = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(above, zero), weights), _mm256_mullo_epi16(_mm256_unpackhi_epi8(below, zero), inverse));
+  return _mm256_packus_epi16(_mm256_srli_epi16(low, 8), _mm256_srli_epi16(high, 8));
+}
+
+__attribute__((target("avx2")))
+inline void alphaRowAvx2(const uint32_t* colours, uint32_t* dst, int count, int weight)
+{
+  const __m256i weights = _mm256_set1_epi16(static_cast<short>(weight));
+  const __m256i inverse = _mm256_set1_epi16(static_cast<short>(256 - weight));
+  int x = 0;
+  for (; x + 8 <= count; x += 8)
+  {
+    __m256i* below = reinterpret_cast<__m256i*>(dst + x);
+    __m256i above = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(colours + x));
+    __m256i pixels = _mm256_loadu_si256(below);
+    _mm256_storeu_si256(below, _mm256_blendv_epi8(mixAvx2(pixels, above, weights, inverse), pixels, transparentAvx2(above)));
+  }
+  alphaRowScalar(colours + x, dst + x, count - x, weight);
+}
+
+#endif
+
+/**
+ * The kernels of the compositor, one blending function per BlendMode
+ **/
+struct CompositeKernels
+{
+  CoverRowFunction cover;
+  BlendRowFunction blend[3];
+};
+
+const CompositeKernels COMPOSITE_SCALAR = {coverRowScalar, {keyRowScalar, addRowScalar, alphaRowScalar}};
+#ifdef LXF_X86
+const CompositeKernels COMPOSITE_SSE2 = {coverRowSse2, {keyRowSse2, addRowSse2, alphaRowSse2}};
+const CompositeKernels COMPOSITE_AVX2 = {coverRowAvx2, {keyRowAvx2, addRowAvx2, alphaRowAvx2}};
+#endif
+
+/**
+ * Picks the fastest kernels for the given tier, the one of the CPU by default.
+ * There are no AVX-512 ones, that tier gets the AVX2 kernels.
+ **/
+inline CompositeKernels selectCompositeKernels(CpuTier tier = cpuTier())
+{
+#ifdef LXF_X86
+  if (tier >= CPU_AVX2) return COMPOSITE_AVX2;
+  if (tier >= CPU_SSE2) return COMPOSITE_SSE2;
+#endif
+  return COMPOSITE_SCALAR;
+}
+
+/**
+ * Puts the layers of an effect over its screen, into ARGB8888 pixels. The screen
+ * is expanded through its palette straight into the target, then every layer is
+ * expanded through its own palette and blended over it, a row at a time.
+ *
+ * The transparent colours of a layer are expanded with an alpha of 0, which is
+ * how the blending kernels tell them apart. Only the parts of a layer which are
+ * not transparent cost more than a look at them: the blocks of COVERAGE_BLOCK
+ * pixels of a row holding only the first transparent colour (the background,
+ * usually) are found first, and the runs of the other blocks are expanded and
+ * blended at once. A scroller over a tunnel costs the expansion of the tunnel,
+ * a pass over the scroller and the blending of the text.
+ **/
+class Compositor
+{
+public:
+  explicit Compositor(CompositeKernels kernels = selectCompositeKernels()) : kernels(kernels) {}
+
+  // The target has the size of the screen, its rows are pitch bytes apart
+  void composite(const Framebuffer& screen, const Palette& palette, const std::vector<Layer>& layers, uint8_t* target, int pitch)
+  {
+    const int width = screen.width();
+    const int blocks = (width + COVERAGE_BLOCK - 1) / COVERAGE_BLOCK;
+    coverage.resize((blocks + 63) / 64);
+    colours.resize(width);
+
+    buildPaletteLut(palette, lut);
+    layerLuts.resize(layers.size());
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+      buildPaletteLut(*layers[i].palette, layerLuts[i]);
+      for (int colour = 0; colour < 256; colour++)
+      {
+        if (layers[i].transparent[colour]) layerLuts[i].argb[colour] &= 0x00FFFFFF;
+      }
+    }
+
+    for (int y = 0; y < screen.height(); y++)
+    {
+      uint32_t* row = reinterpret_cast<uint32_t*>(target + static_cast<ptrdiff_t>(y) * pitch);
+      expandPalette(screen.row(y), row, width, lut);
+
+      for (size_t i = 0; i < layers.size(); i++)
+      {
+        const Layer& layer = layers[i];
+        if (layer.screen->width() != width || layer.screen->height() != screen.height()) continue;
+
+        const uint8_t* indices = layer.screen->row(y);
+        const BlendRowFunction blend = kernels.blend[layer.mode];
+        const int weight = layer.alpha + (layer.alpha >> 7);
+        if (layer.transparent.none())
+        {
+          std::fill(coverage.begin(), coverage.end(), ~uint64_t(0));
+        }
+        else
+        {
+          kernels.cover(indices, blocks, firstTransparent(layer), coverage.data());
+        }
+
+        for (size_t word = 0; word < coverage.size(); word++)
+        {
+          for (uint64_t bits = coverage[word]; bits; )
+          {
+            // The run of covered blocks starting at the lowest bit left
+            int first = __builtin_ctzll(bits);
+            uint64_t rest = ~(bits >> first);
+            int length = rest ? __builtin_ctzll(rest) : 64 - first;
+            bits = length + first < 64 ? bits & (~uint64_t(0) << (first + length)) : 0;
+
+            int x0 = (static_cast<int>(word) * 64 + first) * COVERAGE_BLOCK;
+            int x1 = std::min(width, x0 + length * COVERAGE_BLOCK);
+            expandPalette(indices + x0, colours.data() + x0, x1 - x0, layerLuts[i]);
+            blend(colours.data() + x0, row + x0, x1 - x0, weight);
+          }
+        }
+      }
+    }
+  }
+
+private:
+  static uint8_t firstTransparent(const Layer& layer)
+  {
+    int colour = 0;
+    while (!layer.transparent[colour]) colour++;
+    return static_cast<uint8_t>(colour);
+  }
+
+  CompositeKernels kernels;
+  PaletteLut lut;
+  std::vector<PaletteLut> layerLuts;
+  std::vector<uint64_t> coverage;         // The covered blocks of the row of a layer
+  std::vector<uint32_t> colours;          // The covered pixels of the row of a layer, expanded
+};
+
+/**
+ * A copy of the layers of an effect, screens and palettes included, so they can
+ * be shown (or recorded) while the effect goes on drawing the next frame. The
+ * screens are copied with Framebuffer::copyFrom(), only the changed rows once
+ * the copy is made again.
+ **/
+class LayerCopy
+{
+public:
+  void copyFrom(const std::vector<Layer>& layers)
+  {
+    screens.resize(layers.size());
+    palettes.resize(layers.size());
+    copies = layers;
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+      screens[i].copyFrom(*layers[i].screen);
+      palettes[i] = *layers[i].palette;
+      copies[i].screen = &screens[i];
+      copies[i].palette = &palettes[i];
+    }
+  }
+
+  const std::vector<Layer>& layers() const { return copies; }
+
+private:
+  std::vector<Framebuffer> screens;
+  std::vector<Palette> palettes;
+  std::vector<Layer> copies;            // The layers, pointing to the copies
+};
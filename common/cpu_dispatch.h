@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LXF_X86 1
+#endif
+
+/**
+ * The instruction sets the hot kernels are written for, from the oldest one.
+ * The kernels are compiled for all of them into the same binary (with the target
+ * attribute, not -march), and every kernel has a select...() function picking
+ * its best version for cpuTier(). A kernel without a version for a tier uses
+ * the one of the tier below.
+ **/
+enum CpuTier
+{
+  CPU_SCALAR,         // Plain C++, also what the machines other than x86 get
+  CPU_SSE2,           // Every x86-64 has it
+  CPU_AVX2,
+  CPU_AVX512,         // AVX-512F
+  CPU_TIER_COUNT
+};
+
+inline const char* cpuTierName(CpuTier tier)
+{
+  static const char* const NAMES[CPU_TIER_COUNT] = {"scalar", "sse2", "avx2", "avx512"};
+  return NAMES[tier];
+}
+
+inline bool parseCpuTier(const std::string& name, CpuTier& tier)
+{
+  for (int i = 0; i < CPU_TIER_COUNT; i++)
+  {
+    if (name == cpuTierName(static_cast<CpuTier>(i)))
+    {
+      tier = static_cast<CpuTier>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * The best tier the CPU we run on supports
+ **/
+inline CpuTier detectCpuTier()
+{
+#ifdef LXF_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+  {
+    return CPU_AVX512;
+  }
+  if (__builtin_cpu_supports("avx2"))
+  {
+    return CPU_AVX2;
+  }
+  return CPU_SSE2;
+#else
+  return CPU_SCALAR;
+#endif
+}
+
+/**
+ * The tier the kernels are picked for: the one of the CPU, unless the LXF_CPU_TIER
+ * environment variable (scalar, sse2, avx2 or avx512) asks for a lower one, so
+ * that every version of the kernels can be tested and measured on the same
+ * machine. It is decided on the first call, and stays the same afterwards.
+ **/
+inline CpuTier cpuTier()
+{
+  static const CpuTier tier = [] {
+    CpuTier supported = detectCpuTier();
+    const char* env = getenv("LXF_CPU_TIER");
+    if (!env || !*env)
+    {
+      return supported;
+    }
+
+    CpuTier forced;
+    if (!parseCpuTier(env, forced))
+    {
+      std::cerr << "Unknown LXF_CPU_TIER:" << env << ", using " << cpuTierName(supported) << std::endl;
+      return supported;
+    }
+    if (forced > supported)
+    {
+      std::cerr << "The CPU does not support LXF_CPU_TIER:" << env << ", using " << cpuTierName(supported) << std::endl;
+      return supported;
+    }
+    return forced;
+  }();
+  return tier;
+}
@@ -0,0 +1,406 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "effect.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LXF_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * The header of the binary .custom files. The palette (256 RGBA entries, the
+ * unused ones zeroed) follows the header, then come the palette indices of the
+ * pixels, one byte each, row by row, starting on a 64 byte boundary so the file
+ * can be mapped into memory and the pixels used from there as they are.
+ *
+ * All the fields are little endian, which is what every machine running the
+ * series is.
+ **/
+struct CustomImageHeader
+{
+  char magic[4];                // CUSTOM_IMAGE_MAGIC
+  uint32_t version;             // CUSTOM_IMAGE_VERSION
+  uint32_t width;
+  uint32_t height;
+  uint32_t colours;             // The number of palette entries used by the image
+  uint32_t paletteOffset;       // Where the palette starts, from the start of the file
+  uint32_t dataOffset;          // Where the pixels start, from the start of the file
+  uint32_t reserved[9];
+};
+
+static_assert(sizeof(CustomImageHeader) == 64, "the header of the .custom files is 64 bytes long");
+
+const char CUSTOM_IMAGE_MAGIC[4] = {'L', 'X', 'F', 'I'};
+const uint32_t CUSTOM_IMAGE_VERSION = 1;
+const uint32_t CUSTOM_IMAGE_ALIGNMENT = 64;
+
+/**
+ * A palette based image, as made by tools/custom_img_creator. Binary files are
+ * mapped into memory and used in place, the old text files are parsed into
+ * memory owned by the image.
+ **/
+class CustomImage
+{
+public:
+  CustomImage() = default;
+  CustomImage(const CustomImage&) = delete;
+  CustomImage& operator=(const CustomImage&) = delete;
+
+  ~CustomImage()
+  {
+    release();
+  }
+
+  unsigned width() const { return w; }
+  unsigned height() const { return h; }
+
+  // The palette indices of the pixels, row by row
+  const uint8_t* pixels() const { return data; }
+  size_t size() const { return static_cast<size_t>(w) * h; }
+
+  int colourCount() const { return count; }
+  const Colour& colour(int i) const { return colours[i]; }
+
+  /**
+   * Copies the colours of the image into the first entries of the given palette,
+   * at most maxColours of them. The rest of the palette is left as it was.
+   **/
+  void applyPalette(Palette& palette, int maxColours = 256) const
+  {
+    for (int i = 0; i < count && i < maxColours; i++)
+    {
+      palette[i] = colours[i];
+    }
+  }
+
+  // Tells whether the image has at least the given size, the effects sample it up to there
+  bool covers(unsigned width, unsigned height) const
+  {
+    return w >= width && h >= height;
+  }
+
+  /**
+   * Makes the image hold the given pixels, in memory of its own
+   **/
+  void assign(unsigned width, unsigned height, const std::vector<Colour>& palette, std::vector<uint8_t>&& indices)
+  {
+    release();
+    w = width;
+    h = height;
+    count = static_cast<int>(std::min<size_t>(palette.size(), 256));
+    std::copy(palette.begin(), palette.begin() + count, colours.begin());
+    owned = std::move(indices);
+    owned.resize(size());
+    data = owned.data();
+  }
+
+  /**
+   * Uses the binary .custom file found in the given memory, after checking its
+   * header. If mapped is true the pixels are used in place and the image unmaps
+   * the memory when it goes away, otherwise they are copied.
+   **/
+  bool adopt(const std::string& filename, const uint8_t* memory, size_t length, bool mapped)
+  {
+    release();
+    if (mapped)
+    {
+      mapping = memory;
+      mappingLength = length;
+    }
+
+    CustomImageHeader header;
+    if (length < sizeof(header))
+    {
+      std::cerr << "Truncated image file: " << filename << std::endl;
+      return false;
+    }
+    memcpy(&header, memory, sizeof(header));
+
+    if (header.version != CUSTOM_IMAGE_VERSION)
+    {
+      std::cerr << "Unsupported image version " << header.version << ": " << filename << std::endl;
+      return false;
+    }
+
+    size_t pixelCount = static_cast<size_t>(header.width) * header.height;
+    if (header.colours > 256 || header.paletteOffset + 256 * sizeof(Colour) > length ||
+        header.dataOffset > length || length - header.dataOffset < pixelCount)
+    {
+      std::cerr << "Truncated image file: " << filename << std::endl;
+      return false;
+    }
+
+    w = header.width;
+    h = header.height;
+    count = static_cast<int>(header.colours);
+    memcpy(colours.data(), memory + header.paletteOffset, count * sizeof(Colour));
+    if (mapped)
+    {
+      data = memory + header.dataOffset;
+    }
+    else
+    {
+      owned.assign(memory + header.dataOffset, memory + header.dataOffset + pixelCount);
+      data = owned.data();
+    }
+    return true;
+  }
+
+private:
+  void release()
+  {
+#ifdef LXF_MMAP
+    if (mapping)
+    {
+      munmap(const_cast<uint8_t*>(mapping), mappingLength);
+    }
+#endif
+    mapping = nullptr;
+    mappingLength = 0;
+    owned.clear();
+    data = nullptr;
+    w = h = 0;
+    count = 0;
+  }
+
+  unsigned w = 0;
+  unsigned h = 0;
+  int count = 0;
+  Palette colours = defaultPalette();
+  const uint8_t* data = nullptr;
+  std::vector<uint8_t> owned;
+  const uint8_t* mapping = nullptr;
+  size_t mappingLength = 0;
+};
+
+/**
+ * Reads the unsigned number starting at text into value, and moves text past it.
+ * Returns false if there is no number there, or it is larger than max.
+ **/
+inline bool parseTextNumber(const char*& text, const char* end, unsigned max, unsigned& value)
+{
+  std::from_chars_result result = std::from_chars(text, end, value);
+  if (result.ec != std::errc() || value > max)
+  {
+    return false;
+  }
+  text = result.ptr;
+  return true;
+}
+
+// Moves text past the spaces and commas separating the numbers of a line
+inline void skipTextSeparators(const char*& text, const char* end)
+{
+  while (text < end && (*text == ' ' || *text == ',' || *text == '\t' || *text == '\r'))
+  {
+    text++;
+  }
+}
+
+/**
+ * Reads the old text format: a "WIDTHxHEIGHT" line, one "r, g, b, a" line for
+ * every colour of the palette, an empty line, and then the palette indices of
+ * the pixels, separated by spaces, one row of the image per line.
+ *
+ * The file is read with one call and parsed in place, the pixels going straight
+ * into memory allocated once for the size given in the first line, so this stays
+ * fast for images of several megapixels.
+ **/
+inline bool loadTextCustomImage(const std::string& filename, CustomImage& image)
+{
+  std::ifstream inFile(filename, std::ios::binary | std::ios::ate);
+  if (!inFile.is_open())
+  {
+    std::cerr << "Error opening file for reading: " << filename << std::endl;
+    return false;
+  }
+
+  std::vector<char> contents(static_cast<size_t>(inFile.tellg()));
+  inFile.seekg(0);
+  inFile.read(contents.data(), contents.size());
+  const char* text = contents.data();
+  const char* end = text + contents.size();
+
+  unsigned width = 0, height = 0;
+  if (!parseTextNumber(text, end, 65535, width) || text == end || *text++ != 'x' ||
+      !parseTextNumber(text, end, 65535, height))
+  {
+    std::cerr << "Invalid image size in " << filename << std::endl;
+    return false;
+  }
+  skipTextSeparators(text, end);
+
+  // One colour per line, until the first empty one
+  std::vector<Colour> palette;
+  palette.reserve(256);
+  while (text < end && *text == '\n')
+  {
+    text++;
+    skipTextSeparators(text, end);
+    if (text == end || *text == '\n')
+    {
+      break;
+    }
+
+    unsigned rgba[4];
+    for (unsigned& component : rgba)
+    {
+      skipTextSeparators(text, end);
+      if (!parseTextNumber(text, end, 255, component))
+      {
+        std::cerr << "Invalid colour " << palette.size() << " in " << filename << std::endl;
+        return false;
+      }
+    }
+    if (palette.size() == 256)
+    {
+      std::cerr << "More than 256 colours in " << filename << std::endl;
+      return false;
+    }
+    palette.push_back(Colour{static_cast<uint8_t>(rgba[0]), static_cast<uint8_t>(rgba[1]),
+                             static_cast<uint8_t>(rgba[2]), static_cast<uint8_t>(rgba[3])});
+    skipTextSeparators(text, end);
+  }
+
+  std::vector<uint8_t> indices(static_cast<size_t>(width) * height);
+  size_t count = 0;
+  while (text < end)
+  {
+    if (*text == '\n' || *text == ' ' || *text == '\r' || *text == '\t')
+    {
+      text++;
+      continue;
+    }
+
+    unsigned index;
+    if (count == indices.size() || !parseTextNumber(text, end, 255, index))
+    {
+      std::cerr << "Invalid pixel " << count << " in " << filename << std::endl;
+      return false;
+    }
+    indices[count++] = static_cast<uint8_t>(index);
+  }
+
+  if (count != indices.size())
+  {
+    std::cerr << "Expected " << indices.size() << " pixels, found " << count << " in " << filename << std::endl;
+    return false;
+  }
+
+  image.assign(width, height, palette, std::move(indices));
+  return true;
+}
+
+/**
+ * Maps a binary .custom file into memory, or reads it if mapping is not
+ * available on this system
+ **/
+inline bool loadBinaryCustomImage(const std::string& filename, CustomImage& image)
+{
+#ifdef LXF_MMAP
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    std::cerr << "Error opening file for reading: " << filename << std::endl;
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0)
+  {
+    close(fd);
+    std::cerr << "Truncated image file: " << filename << std::endl;
+    return false;
+  }
+
+  void* memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED)
+  {
+    std::cerr << "Cannot map file: " << filename << std::endl;
+    return false;
+  }
+  return image.adopt(filename, static_cast<const uint8_t*>(memory), info.st_size, true);
+#else
+  std::ifstream inFile(filename, std::ios::binary);
+  if (!inFile.is_open())
+  {
+    std::cerr << "Error opening file for reading: " << filename << std::endl;
+    return false;
+  }
+
+  std::vector<uint8_t> contents((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+  return image.adopt(filename, contents.data(), contents.size(), false);
+#endif
+}
+
+/**
+ * Loads a .custom image, in the binary or in the old text format, telling them
+ * apart by the first bytes of the file
+ **/
+inline bool loadCustomImage(const std::string& filename, CustomImage& image)
+{
+  char magic[sizeof(CUSTOM_IMAGE_MAGIC)] = {0};
+  {
+    std::ifstream inFile(filename, std::ios::binary);
+    if (!inFile.is_open())
+    {
+      std::cerr << "Error opening file for reading: " << filename << std::endl;
+      return false;
+    }
+    inFile.read(magic, sizeof(magic));
+  }
+
+  if (memcmp(magic, CUSTOM_IMAGE_MAGIC, sizeof(magic)) == 0)
+  {
+    return loadBinaryCustomImage(filename, image);
+  }
+  return loadTextCustomImage(filename, image);
+}
+
+/**
+ * Writes an image in the binary .custom format
+ **/
+inline bool writeCustomImage(const std::string& filename, unsigned width, unsigned height,
+                             const std::vector<Colour>& palette, const uint8_t* indices)
+{
+  std::ofstream outFile(filename, std::ios::binary);
+  if (!outFile.is_open())
+  {
+    std::cerr << "Error opening file for writing: " << filename << std::endl;
+    return false;
+  }
+
+  CustomImageHeader header = {};
+  memcpy(header.magic, CUSTOM_IMAGE_MAGIC, sizeof(header.magic));
+  header.version = CUSTOM_IMAGE_VERSION;
+  header.width = width;
+  header.height = height;
+  header.colours = static_cast<uint32_t>(std::min<size_t>(palette.size(), 256));
+  header.paletteOffset = sizeof(header);
+  uint32_t paletteEnd = header.paletteOffset + 256 * sizeof(Colour);
+  header.dataOffset = (paletteEnd + CUSTOM_IMAGE_ALIGNMENT - 1) / CUSTOM_IMAGE_ALIGNMENT * CUSTOM_IMAGE_ALIGNMENT;
+
+  std::vector<Colour> colours(256, Colour{0, 0, 0, 0});
+  std::copy(palette.begin(), palette.begin() + header.colours, colours.begin());
+
+  outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  outFile.write(reinterpret_cast<const char*>(colours.data()), colours.size() * sizeof(Colour));
+  std::vector<char> padding(header.dataOffset - paletteEnd, 0);
+  outFile.write(padding.data(), padding.size());
+  outFile.write(reinterpret_cast<const char*>(indices), static_cast<size_t>(width) * height);
+  return static_cast<bool>(outFile);
+}
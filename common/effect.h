@@ -0,0 +1,224 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "arena.h"
+#include "effect_state.h"
+#include "framebuffer.h"
+
+/**
+ * One entry of a palette. It has the same layout as SDL_Color, but does not need
+ * SDL, so the effects can be compiled and run on machines without a display.
+ **/
+struct Colour
+{
+  uint8_t r, g, b, a;
+};
+
+typedef std::array<Colour, 256> Palette;
+
+/**
+ * Returns a palette with all the entries set to white, which is what SDL gives us
+ * for a freshly created 8 bit surface. The effects setting less than 256 colours
+ * rely on this.
+ **/
+inline Palette defaultPalette()
+{
+  Palette palette;
+  palette.fill(Colour{255, 255, 255, 255});
+  return palette;
+}
+
+/**
+ * How the pixels of a layer are put over the ones below it. The pixels of the
+ * transparent colours of the layer are left out in all the modes.
+ **/
+enum BlendMode
+{
+  BLEND_COLOUR_KEY,           // The other pixels replace the ones below
+  BLEND_ADDITIVE,             // The colours are added, saturating
+  BLEND_ALPHA                 // The colours are mixed, by the opacity of the layer
+};
+
+/**
+ * A screen shown over the screen of an effect, with a palette of its own. It has
+ * the size of the screen it is shown over.
+ **/
+struct Layer
+{
+  const Framebuffer* screen = nullptr;
+  const Palette* palette = nullptr;
+  BlendMode mode = BLEND_COLOUR_KEY;
+  std::bitset<256> transparent = 1;     // The colours which show what is below, colour 0 by default
+  uint8_t alpha = 255;                  // The opacity of the layer for BLEND_ALPHA, 255 is opaque
+};
+
+/**
+ * An effect caught between two frames: everything it needs to go on from there
+ * as if it had never stopped. See Effect::snapshot().
+ **/
+struct EffectSnapshot
+{
+  long frame = 0;                   // The frame the next update() draws
+  Framebuffer screen;               // The screen, with its guard bands
+  Palette palette = defaultPalette();
+  std::vector<uint8_t> state;       // What the effect keeps besides, see Effect::saveState()
+};
+
+/**
+ * The interface implemented by all the effects of the series. The host creates
+ * the framebuffer, tells its size to the effect with resize(), calls init() once
+ * and then update() for every frame, presenting the framebuffer with the current
+ * palette after each call.
+ **/
+class Effect
+{
+public:
+  virtual ~Effect() = default;
+
+  // The title of the window the effect is shown in
+  virtual const char* title() const = 0;
+
+  // The size of the screen the effect was written for, used unless another one is asked for
+  virtual int width() const = 0;
+  virtual int height() const = 0;
+
+  // How many frames per second the effect was designed to be calculated with
+  virtual double updateRate() const { return 60; }
+
+  /**
+   * Sets the size of the screen the effect draws on. Called with the framebuffer
+   * already at the new size (and cleared) before init(), and again whenever the
+   * window is resized. The effect reallocates everything depending on the size
+   * and redraws what init() has drawn. Effects which can only draw at the size
+   * they were written for return false, their frames are scaled to the window.
+   **/
+  virtual bool resize(Framebuffer& screen)
+  {
+    return screen.width() == width() && screen.height() == height();
+  }
+
+  /**
+   * Called once, before the first frame. Loads the assets and draws the initial
+   * screen. Returns false if the effect cannot run.
+   **/
+  virtual bool init(Framebuffer& screen) = 0;
+
+  /**
+   * Calculates the next frame of the effect on the given screen. Returns false
+   * when the effect has finished and there is nothing more to show.
+   **/
+  virtual bool update(Framebuffer& screen) = 0;
+
+  /**
+   * Draws the given frame (0 is the one the first update() draws) without the
+   * ones before it, for the effects whose frames are a function of their number.
+   * It changes nothing in the effect, so after init() the frames can be drawn in
+   * any order, and on several threads at once (on screens of the size of the
+   * last resize()). Returns false for the effects which cannot do it, the
+   * simulations building every frame on the one before.
+   **/
+  virtual bool drawFrame(Framebuffer& screen, long frame) const { return false; }
+
+  // The number of frames of the effect, 0 if it goes on until it is stopped
+  virtual long frameCount() const { return 0; }
+
+  // The frame shown the given number of seconds after the start, at the rate of the effect
+  long frameAt(double seconds) const
+  {
+    return static_cast<long>(std::floor(seconds * updateRate()));
+  }
+
+  /**
+   * Makes the next update() draw the given frame, at once. Only the effects
+   * which can draw their frames on their own (see drawFrame()) can do it, the
+   * others return false; they are brought to a frame from a snapshot taken
+   * before it, see EffectSeeker.
+   **/
+  virtual bool seek(long frame) { return false; }
+
+  /**
+   * Writes what the effect needs to go on from the current frame, besides its
+   * screen and palette: the counters, the random generators, the buffers of the
+   * simulations. Returns false for the effects which cannot be snapshotted.
+   **/
+  virtual bool saveState(StateWriter& state) const { return false; }
+
+  /**
+   * Reads back what saveState() has written, in an effect initialized the same
+   * way (with the same seed, at the same size). Returns false if it cannot.
+   **/
+  virtual bool loadState(StateReader& state) { return false; }
+
+  /**
+   * Takes a snapshot of the effect and its screen, as they are before the given
+   * frame is drawn. Returns false if the effect cannot be snapshotted.
+   **/
+  bool snapshot(const Framebuffer& screen, long frame, EffectSnapshot& snapshot) const
+  {
+    StateWriter state(snapshot.state);
+    if (!saveState(state))
+    {
+      return false;
+    }
+    snapshot.frame = frame;
+    snapshot.palette = colours;
+    if (snapshot.screen.width() != screen.width() || snapshot.screen.height() != screen.height())
+    {
+      snapshot.screen.resize(screen.width(), screen.height());
+    }
+    copyScreen(screen, snapshot.screen);
+    return true;
+  }
+
+  /**
+   * Brings the effect and its screen back to the snapshot, so that the next
+   * update() draws its frame. The screen has to have the size it had when the
+   * snapshot was taken. Returns false (having changed nothing but, possibly,
+   * the state of the effect) if it cannot be done.
+   **/
+  bool restore(Framebuffer& screen, const EffectSnapshot& snapshot)
+  {
+    if (screen.width() != snapshot.screen.width() || screen.height() != snapshot.screen.height())
+    {
+      return false;
+    }
+    StateReader state(snapshot.state);
+    if (!loadState(state) || !state.finished())
+    {
+      return false;
+    }
+    colours = snapshot.palette;
+    copyScreen(snapshot.screen, screen);
+    screen.markDirty(0, screen.height());
+    return true;
+  }
+
+  // The palette the screen is shown with. Effects are free to change it between frames.
+  const Palette& palette() const { return colours; }
+
+  // The layers shown over the screen, from the bottom up. Most effects have none.
+  const std::vector<Layer>& layers() const { return overlays; }
+
+  // The colours of the screen which let the effects below show through, when the effect is drawn over others
+  virtual std::vector<uint8_t> transparentColours() const { return {0}; }
+
+protected:
+  // Copies all the rows of a screen, guard bands included, to another one of the same size
+  static void copyScreen(const Framebuffer& from, Framebuffer& to)
+  {
+    for (int y = -Framebuffer::GUARD_ROWS; y < from.height() + Framebuffer::GUARD_ROWS; y++)
+    {
+      memcpy(to.row(y), from.row(y), from.stride());
+    }
+  }
+
+  Palette colours = defaultPalette();
+  std::vector<Layer> overlays;
+  Arena arena;                // The buffers of the effect, reset and allocated again by resize()
+};
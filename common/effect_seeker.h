@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "effect.h"
+#include "framebuffer.h"
+
+/**
+ * Brings an effect to any of its frames, forwards or backwards.
+ *
+ * The effects which can draw their frames on their own (see Effect::seek()) get
+ * there at once. The simulations are restored from the last snapshot taken
+ * before the frame, and updated from there: the seeker takes one every interval
+ * frames it sees drawn, so going back, or restarting, never replays the effect
+ * from its first frame. The snapshots are thinned out (and the interval doubled)
+ * when there are too many of them, so a long run keeps a bounded number. With an
+ * interval of 0 only the snapshot of the start is taken.
+ **/
+class EffectSeeker
+{
+public:
+  explicit EffectSeeker(long interval = 64, size_t maxKeyframes = 32) : every(interval), most(maxKeyframes) {}
+
+  /**
+   * Called after init() (and after every resize(), which the snapshots do not
+   * survive): forgets the snapshots and takes one of the start
+   **/
+  void start(const Effect& effect, const Framebuffer& screen)
+  {
+    keyframes.clear();
+    position = 0;
+    takeKeyframe(effect, screen);
+  }
+
+  /**
+   * Called after every update() made without the seeker, so that it knows the
+   * frame the effect is at, and takes its snapshots
+   **/
+  void advanced(const Effect& effect, const Framebuffer& screen)
+  {
+    position++;
+    if (every > 0 && position % every == 0)
+    {
+      takeKeyframe(effect, screen);
+    }
+  }
+
+  // The frame the next update() draws
+  long frame() const { return position; }
+
+  /**
+   * Makes the next update() of the effect draw the given frame. For the
+   * simulations the screen is left as it was before that frame. Returns false
+   * if the effect cannot be brought there: it cannot seek and has no snapshot
+   * before the frame, or it finishes before it.
+   **/
+  bool seek(Effect& effect, Framebuffer& screen, long target)
+  {
+    if (target < 0)
+    {
+      return false;
+    }
+    if (effect.seek(target))
+    {
+      position = target;
+      return true;
+    }
+
+    // The last snapshot before the frame, unless the effect is already closer to it
+    const EffectSnapshot* from = nullptr;
+    for (const EffectSnapshot& keyframe : keyframes)
+    {
+      if (keyframe.frame <= target && (!from || keyframe.frame > from->frame)) from = &keyframe;
+    }
+    if (from && (position > target || position < from->frame))
+    {
+      if (!effect.restore(screen, *from))
+      {
+        return false;
+      }
+      position = from->frame;
+    }
+    if (position > target)
+    {
+      return false;
+    }
+
+    while (position < target)
+    {
+      // The damage is left to add up, the frames skipped are never shown
+      if (!effect.update(screen))
+      {
+        return false;
+      }
+      advanced(effect, screen);
+    }
+    return true;
+  }
+
+  // The number of snapshots kept, and the frames between them
+  size_t keyframeCount() const { return keyframes.size(); }
+  long interval() const { return every; }
+
+private:
+  void takeKeyframe(const Effect& effect, const Framebuffer& screen)
+  {
+    for (const EffectSnapshot& keyframe : keyframes)
+    {
+      if (keyframe.frame == position) return;
+    }
+
+    EffectSnapshot snapshot;
+    if (!effect.snapshot(screen, position, snapshot))
+    {
+      return;
+    }
+    keyframes.push_back(std::move(snapshot));
+
+    // Every other snapshot goes, the ones left are twice as far from each other
+    if (keyframes.size() > most)
+    {
+      every *= 2;
+      std::vector<EffectSnapshot> kept;
+      for (EffectSnapshot& keyframe : keyframes)
+      {
+        if (keyframe.frame % every == 0) kept.push_back(std::move(keyframe));
+      }
+      keyframes = std::move(kept);
+    }
+  }
+
+  long every;
+  size_t most;
+  long position = 0;
+  std::vector<EffectSnapshot> keyframes;
+};
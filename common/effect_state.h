@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "framebuffer.h"
+
+/**
+ * Writes the state of an effect (its counters, height maps and the like) into a
+ * buffer of bytes, for a snapshot. Only plain types are written, as they are in
+ * memory: the bytes are read back by the same program, see StateReader.
+ **/
+class StateWriter
+{
+public:
+  explicit StateWriter(std::vector<uint8_t>& buffer) : bytes(buffer)
+  {
+    bytes.clear();
+  }
+
+  template<class T>
+  void write(const T* values, size_t count)
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "Only plain types can be written into a state");
+    const uint8_t* first = reinterpret_cast<const uint8_t*>(values);
+    bytes.insert(bytes.end(), first, first + count * sizeof(T));
+  }
+
+  template<class T>
+  void write(const T& value)
+  {
+    write(&value, 1);
+  }
+
+  // The size and the elements of the vector
+  template<class T>
+  void write(const std::vector<T>& values)
+  {
+    write(values.size());
+    write(values.data(), values.size());
+  }
+
+  // The size and the pixels of the screen, guard bands included
+  void write(const Framebuffer& screen)
+  {
+    write(screen.width());
+    write(screen.height());
+    write(screen.row(-Framebuffer::GUARD_ROWS), static_cast<size_t>(screen.height() + 2 * Framebuffer::GUARD_ROWS) * screen.stride());
+  }
+
+private:
+  std::vector<uint8_t>& bytes;
+};
+
+/**
+ * Reads back what a StateWriter has written, in the same order. Every read()
+ * returns false, and leaves the value alone, if the state is shorter than what is
+ * asked for.
+ **/
+class StateReader
+{
+public:
+  explicit StateReader(const std::vector<uint8_t>& buffer) : bytes(buffer) {}
+
+  template<class T>
+  bool read(T* values, size_t count)
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "Only plain types can be read from a state");
+    size_t length = count * sizeof(T);
+    if (length > bytes.size() - offset)
+    {
+      return false;
+    }
+    if (length > 0)
+    {
+      memcpy(values, bytes.data() + offset, length);
+    }
+    offset += length;
+    return true;
+  }
+
+  template<class T>
+  bool read(T& value)
+  {
+    return read(&value, 1);
+  }
+
+  template<class T>
+  bool read(std::vector<T>& values)
+  {
+    size_t count = 0;
+    if (!read(count) || count > (bytes.size() - offset) / sizeof(T))
+    {
+      return false;
+    }
+    values.resize(count);
+    return read(values.data(), count);
+  }
+
+  // The pixels of a screen, which has to have the size it was written with
+  bool read(Framebuffer& screen)
+  {
+    int width = 0, height = 0;
+    if (!read(width) || !read(height) || width != screen.width() || height != screen.height())
+    {
+      return false;
+    }
+    return read(screen.row(-Framebuffer::GUARD_ROWS), static_cast<size_t>(height + 2 * Framebuffer::GUARD_ROWS) * screen.stride());
+  }
+
+  // Whether everything has been read, a state read only in part was not written by the same effect
+  bool finished() const { return offset == bytes.size(); }
+
+private:
+  const std::vector<uint8_t>& bytes;
+  size_t offset = 0;
+};
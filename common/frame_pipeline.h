@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+
+#include "compositor.h"
+#include "effect.h"
+#include "framebuffer.h"
+
+/**
+ * A frame travelling from the simulation thread to the presenting one: a copy
+ * of the screen and of the palette it has to be shown with (and of the layers
+ * over it, if the effect has any), plus what the simulation measured while
+ * calculating it.
+ **/
+struct PipelineFrame
+{
+  Framebuffer screen;
+  Palette palette = defaultPalette();
+  LayerCopy layers;
+  int steps = 0;                // The number of updates run for this frame
+  double updateNs = 0;          // The time the updates took
+  bool last = false;            // The frame limit was reached, nothing comes after this one
+  bool finished = false;        // The effect has finished, this frame is not to be shown
+};
+
+/**
+ * Three frames handed over from one producer (the simulation) to one consumer
+ * (the presentation), without locks. While the consumer shows one of them, the
+ * producer can have the next one ready and calculate a third one.
+ *
+ * Both sides only ever move forward their own counter, and read the counter of
+ * the other side to know how far they can go, so no frame is dropped or shown
+ * twice. The try...() calls never block; the caller decides how to wait.
+ **/
+class FramePipeline
+{
+public:
+  static const int SLOTS = 3;
+
+  void resize(int width, int height)
+  {
+    for (PipelineFrame& slot : slots)
+    {
+      slot.screen.resize(width, height);
+    }
+  }
+
+  // The frame to write next, or nullptr if the consumer still holds all of them
+  PipelineFrame* tryBeginWrite()
+  {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == SLOTS) return nullptr;
+    return &slots[h % SLOTS];
+  }
+
+  // Hands the frame returned by tryBeginWrite() over to the consumer
+  void endWrite()
+  {
+    head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  // The oldest frame not shown yet, or nullptr if the producer has not finished one
+  PipelineFrame* tryBeginRead()
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (head.load(std::memory_order_acquire) == t) return nullptr;
+    return &slots[t % SLOTS];
+  }
+
+  // Gives the frame returned by tryBeginRead() back to the producer
+  void endRead()
+  {
+    tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+private:
+  PipelineFrame slots[SLOTS];
+
+  // Written by one thread each, so they are kept on separate cache lines
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+};
+
+/**
+ * Waits a little while one side of the pipeline is ahead of the other: first
+ * it only yields the core, and if the wait goes on it sleeps instead of spinning.
+ **/
+inline void pipelineBackoff(int& spins)
+{
+  if (spins++ < 64)
+  {
+    std::this_thread::yield();
+  }
+  else
+  {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+}
@@ -0,0 +1,349 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "compositor.h"
+#include "effect.h"
+#include "frame_pipeline.h"
+#include "framebuffer.h"
+
+/**
+ * Records the frames of an effect into a video file, for encoding them later
+ * with ffmpeg or the like. The file is a YUV4MPEG2 (4:2:0) stream if its name
+ * ends in .y4m, otherwise raw RGB24 frames one after the other.
+ *
+ * record() only copies the indexed frame and its palette (and the layers over
+ * it, if any) into a queue, the expansion to colours (and the compositing) and
+ * the writing happen on a thread of the recorder, with one write per frame. If
+ * the disk cannot keep up and the queue is full, the frame is dropped instead
+ * of waiting, so recording never slows down the effect.
+ **/
+class FrameRecorder
+{
+public:
+  static const int SLOTS = 8;
+
+  FrameRecorder() = default;
+  FrameRecorder(const FrameRecorder&) = delete;
+  FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+  ~FrameRecorder()
+  {
+    close();
+  }
+
+  /**
+   * Creates the file and starts the writer thread. All the frames are written
+   * at the given size, the ones of another size are scaled to it. The rate is
+   * only stored in the header of the .y4m files.
+   **/
+  bool open(const std::string& filename, int width, int height, double rate)
+  {
+    close();
+
+    file = fopen(filename.c_str(), "wb");
+    if (!file)
+    {
+      std::cerr << "Cannot create the recording:" << filename << std::endl;
+      return false;
+    }
+
+    name = filename;
+    w = width;
+    h = height;
+    y4m = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".y4m") == 0;
+    recorded = 0;
+    dropped = 0;
+    failed = false;
+    stop.store(false, std::memory_order_relaxed);
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+
+    if (y4m)
+    {
+      // The rate as a fraction, 70.086 Hz becomes 35043:500 and the like
+      long numerator = rate > 0 ? static_cast<long>(rate * 1000 + 0.5) : 60000;
+      long denominator = 1000;
+      long divisor = std::gcd(numerator, denominator);
+      fprintf(file, "YUV4MPEG2 W%d H%d F%ld:%ld Ip A1:1 C420jpeg\n", w, h, numerator / divisor, denominator / divisor);
+    }
+
+    writer = std::thread([this] { writeFrames(); });
+    return true;
+  }
+
+  bool isOpen() const { return file != nullptr; }
+
+  /**
+   * Queues the frame to be written, if there is room for it. Returns false if
+   * the frame was dropped. Called by one thread only, never blocks.
+   **/
+  bool record(const Framebuffer& screen, const Palette& palette, const std::vector<Layer>& layers = std::vector<Layer>())
+  {
+    size_t hd = head.load(std::memory_order_relaxed);
+    if (hd - tail.load(std::memory_order_acquire) == SLOTS)
+    {
+      dropped++;
+      return false;
+    }
+
+    Slot& slot = slots[hd % SLOTS];
+    slot.screen.copyFrom(screen);
+    slot.palette = palette;
+    slot.layers.copyFrom(layers);
+    head.store(hd + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Writes the frames still in the queue, then closes the file and tells how
+   * many frames had to be dropped
+   **/
+  void close()
+  {
+    if (!file) return;
+
+    stop.store(true, std::memory_order_release);
+    writer.join();
+    if (fclose(file) != 0) failed = true;
+    file = nullptr;
+
+    if (failed)
+    {
+      std::cerr << "Cannot write the recording:" << name << std::endl;
+    }
+    if (dropped > 0)
+    {
+      std::cerr << "The recording has dropped " << dropped << " of " << (recorded + dropped) << " frames, the disk could not keep up" << std::endl;
+    }
+  }
+
+  // The frames written to the file so far and the ones which did not fit in the queue
+  long recordedFrames() const { return recorded.load(std::memory_order_relaxed); }
+  long droppedFrames() const { return dropped; }
+
+private:
+  struct Slot
+  {
+    Framebuffer screen;
+    Palette palette = defaultPalette();
+    LayerCopy layers;
+  };
+
+  void writeFrames()
+  {
+    for (int spins = 0; ; )
+    {
+      size_t tl = tail.load(std::memory_order_relaxed);
+      if (head.load(std::memory_order_acquire) == tl)
+      {
+        // The queue is empty: leave if the recording is over, otherwise wait for a frame
+        if (stop.load(std::memory_order_acquire) && head.load(std::memory_order_acquire) == tl) return;
+        pipelineBackoff(spins);
+        continue;
+      }
+      spins = 0;
+
+      Slot& slot = slots[tl % SLOTS];
+      if (!failed && !slot.layers.layers().empty())
+      {
+        composited.resize(slot.screen.size());
+        compositor.composite(slot.screen, slot.palette, slot.layers.layers(), reinterpret_cast<uint8_t*>(composited.data()),
+                             slot.screen.width() * static_cast<int>(sizeof(uint32_t)));
+        convertComposited(slot.screen.width(), slot.screen.height());
+        failed = fwrite(output.data(), 1, output.size(), file) != output.size();
+      }
+      else if (!failed)
+      {
+        convert(scaled(slot.screen), slot.palette);
+        failed = fwrite(output.data(), 1, output.size(), file) != output.size();
+      }
+      tail.store(tl + 1, std::memory_order_release);
+      recorded.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // The frame at the size of the recording, nearest neighbour if it has to be scaled
+  const Framebuffer& scaled(const Framebuffer& screen)
+  {
+    if (screen.width() == w && screen.height() == h) return screen;
+
+    if (scratch.width() != w || scratch.height() != h)
+    {
+      scratch.resize(w, h);
+    }
+    for (int y = 0; y < h; y++)
+    {
+      const uint8_t* src = screen.row(static_cast<int>(static_cast<long>(y) * screen.height() / h));
+      uint8_t* dst = scratch.row(y);
+      for (int x = 0; x < w; x++)
+      {
+        dst[x] = src[static_cast<long>(x) * screen.width() / w];
+      }
+    }
+    return scratch;
+  }
+
+  // Expands the indexed frame through the palette into the output buffer, in the format of the file
+  void convert(const Framebuffer& screen, const Palette& palette)
+  {
+    if (!y4m)
+    {
+      output.resize(static_cast<size_t>(w) * h * 3);
+      uint8_t* dst = output.data();
+      for (int y = 0; y < h; y++)
+      {
+        const uint8_t* src = screen.row(y);
+        for (int x = 0; x < w; x++, dst += 3)
+        {
+          const Colour& c = palette[src[x]];
+          dst[0] = c.r;
+          dst[1] = c.g;
+          dst[2] = c.b;
+        }
+      }
+      return;
+    }
+
+    // BT.601, limited range. The chroma of an index is looked up, then averaged over 2x2 pixels.
+    uint8_t lumaOf[256];
+    int blueOf[256], redOf[256];
+    for (int i = 0; i < 256; i++)
+    {
+      int r = palette[i].r, g = palette[i].g, b = palette[i].b;
+      lumaOf[i] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+      blueOf[i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+      redOf[i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+
+    static const char FRAME[] = "FRAME\n";
+    const int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    output.resize(sizeof(FRAME) - 1 + static_cast<size_t>(w) * h + 2 * static_cast<size_t>(cw) * ch);
+    memcpy(output.data(), FRAME, sizeof(FRAME) - 1);
+
+    uint8_t* luma = output.data() + sizeof(FRAME) - 1;
+    uint8_t* blue = luma + static_cast<size_t>(w) * h;
+    uint8_t* red = blue + static_cast<size_t>(cw) * ch;
+
+    for (int y = 0; y < h; y++)
+    {
+      const uint8_t* src = screen.row(y);
+      for (int x = 0; x < w; x++)
+      {
+        luma[static_cast<size_t>(y) * w + x] = lumaOf[src[x]];
+      }
+    }
+
+    for (int y = 0; y < ch; y++)
+    {
+      const uint8_t* top = screen.row(2 * y);
+      const uint8_t* bottom = screen.row(std::min(2 * y + 1, h - 1));
+      for (int x = 0; x < cw; x++)
+      {
+        int left = 2 * x, right = std::min(2 * x + 1, w - 1);
+        int i0 = top[left], i1 = top[right], i2 = bottom[left], i3 = bottom[right];
+        blue[y * cw + x] = static_cast<uint8_t>((blueOf[i0] + blueOf[i1] + blueOf[i2] + blueOf[i3] + 2) >> 2);
+        red[y * cw + x] = static_cast<uint8_t>((redOf[i0] + redOf[i1] + redOf[i2] + redOf[i3] + 2) >> 2);
+      }
+    }
+  }
+
+  /**
+   * The same for a composited frame of the given size, from its ARGB pixels,
+   * nearest neighbour if it has to be scaled
+   **/
+  void convertComposited(int width, int height)
+  {
+    auto pixel = [&](int x, int y) {
+      return composited[static_cast<size_t>(static_cast<long>(y) * height / h) * width + static_cast<long>(x) * width / w];
+    };
+
+    if (!y4m)
+    {
+      output.resize(static_cast<size_t>(w) * h * 3);
+      uint8_t* dst = output.data();
+      for (int y = 0; y < h; y++)
+      {
+        for (int x = 0; x < w; x++, dst += 3)
+        {
+          uint32_t c = pixel(x, y);
+          dst[0] = static_cast<uint8_t>(c >> 16);
+          dst[1] = static_cast<uint8_t>(c >> 8);
+          dst[2] = static_cast<uint8_t>(c);
+        }
+      }
+      return;
+    }
+
+    static const char FRAME[] = "FRAME\n";
+    const int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    output.resize(sizeof(FRAME) - 1 + static_cast<size_t>(w) * h + 2 * static_cast<size_t>(cw) * ch);
+    memcpy(output.data(), FRAME, sizeof(FRAME) - 1);
+
+    uint8_t* luma = output.data() + sizeof(FRAME) - 1;
+    uint8_t* blue = luma + static_cast<size_t>(w) * h;
+    uint8_t* red = blue + static_cast<size_t>(cw) * ch;
+
+    for (int y = 0; y < h; y++)
+    {
+      for (int x = 0; x < w; x++)
+      {
+        uint32_t c = pixel(x, y);
+        int r = (c >> 16) & 0xFF, g = (c >> 8) & 0xFF, b = c & 0xFF;
+        luma[static_cast<size_t>(y) * w + x] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+      }
+    }
+
+    for (int y = 0; y < ch; y++)
+    {
+      for (int x = 0; x < cw; x++)
+      {
+        int blueSum = 0, redSum = 0;
+        for (int dy = 0; dy < 2; dy++)
+        {
+          for (int dx = 0; dx < 2; dx++)
+          {
+            uint32_t c = pixel(std::min(2 * x + dx, w - 1), std::min(2 * y + dy, h - 1));
+            int r = (c >> 16) & 0xFF, g = (c >> 8) & 0xFF, b = c & 0xFF;
+            blueSum += ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+            redSum += ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+          }
+        }
+        blue[y * cw + x] = static_cast<uint8_t>((blueSum + 2) >> 2);
+        red[y * cw + x] = static_cast<uint8_t>((redSum + 2) >> 2);
+      }
+    }
+  }
+
+  FILE* file = nullptr;
+  std::string name;
+  int w = 0;
+  int h = 0;
+  bool y4m = false;
+  bool failed = false;                  // Only touched by the writer until it was joined
+  long dropped = 0;                     // Only touched by the thread calling record()
+  std::atomic<long> recorded{0};
+
+  std::thread writer;
+  std::atomic<bool> stop{false};
+  Slot slots[SLOTS];
+
+  // The writer's own buffers
+  Framebuffer scratch;
+  std::vector<uint8_t> output;
+  Compositor compositor;
+  std::vector<uint32_t> composited;     // The last frame with layers, composited
+
+  // Moved forward by record() and the writer respectively, on separate cache lines
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+};
@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "effect.h"
+#include "framebuffer.h"
+
+/**
+ * The phases a frame goes through, from waiting for the frame to be due until the
+ * picture is on the screen
+ **/
+enum FramePhase
+{
+  PHASE_WAIT,       // Sleeping in the scheduler until the next frame is due
+  PHASE_UPDATE,     // The updateScreen() of the effect
+  PHASE_EXPAND,     // Expanding the indexed screen through the palette into the texture
+  PHASE_COPY,       // SDL_RenderCopy of the texture
+  PHASE_PRESENT,    // SDL_RenderPresent
+  PHASE_COUNT
+};
+
+inline const char* phaseName(int phase)
+{
+  static const char* names[PHASE_COUNT] = {"wait", "update", "expand", "copy", "present"};
+  return names[phase];
+}
+
+/**
+ * Returns the value below which the given fraction of the (sorted) samples are
+ **/
+inline double percentile(const std::vector<double>& sorted, double fraction)
+{
+  if (sorted.empty()) return 0;
+  size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+/**
+ * The timings of one frame, in nanoseconds
+ **/
+struct FrameRecord
+{
+  long frame = 0;
+  int steps = 0;                        // How many updates were calculated for this frame
+  double phases[PHASE_COUNT] = {0};
+  double total = 0;                     // From the beginning of this frame to the beginning of the next one
+};
+
+/**
+ * Keeps the timings of the last few thousand frames in a ring buffer. The cost
+ * of the bookkeeping is a couple of clock reads per phase, so it can stay on in
+ * production.
+ **/
+class FrameStats
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  explicit FrameStats(size_t capacity = 4096) : records(capacity) {}
+
+  void beginFrame()
+  {
+    Clock::time_point now = Clock::now();
+    if (inFrame)
+    {
+      endFrame(now);
+    }
+    current = FrameRecord();
+    current.frame = frames;
+    frameStart = now;
+    inFrame = true;
+  }
+
+  void setSteps(int steps) { current.steps = steps; }
+
+  void add(FramePhase phase, double ns) { current.phases[phase] += ns; }
+
+  // Closes the last frame, if there is one open
+  void finish()
+  {
+    if (inFrame)
+    {
+      endFrame(Clock::now());
+      inFrame = false;
+    }
+  }
+
+  // The number of frames recorded so far, including the ones which left the ring buffer
+  long recordedFrames() const { return frames; }
+
+  // The number of frames currently in the ring buffer
+  size_t size() const { return std::min<size_t>(frames, records.size()); }
+
+  // The i-th oldest frame still in the ring buffer
+  const FrameRecord& at(size_t i) const
+  {
+    size_t first = frames > static_cast<long>(records.size()) ? frames % records.size() : 0;
+    return records[(first + i) % records.size()];
+  }
+
+  /**
+   * The average of the given phase (or of the whole frame if phase is PHASE_COUNT)
+   * over the last count frames, in nanoseconds
+   **/
+  double average(int phase, size_t count) const
+  {
+    size_t n = std::min(count, size());
+    if (n == 0) return 0;
+    double sum = 0;
+    for (size_t i = size() - n; i < size(); i++)
+    {
+      sum += phase == PHASE_COUNT ? at(i).total : at(i).phases[phase];
+    }
+    return sum / n;
+  }
+
+  bool writeCsv(const std::string& filename) const
+  {
+    std::ofstream out(filename);
+    if (!out.is_open())
+    {
+      std::cerr << "Error opening file for writing: " << filename << std::endl;
+      return false;
+    }
+
+    out << "frame,steps";
+    for (int p = 0; p < PHASE_COUNT; p++) out << "," << phaseName(p) << "_ns";
+    out << ",total_ns\n";
+
+    out << std::fixed << std::setprecision(0);
+    for (size_t i = 0; i < size(); i++)
+    {
+      const FrameRecord& r = at(i);
+      out << r.frame << "," << r.steps;
+      for (int p = 0; p < PHASE_COUNT; p++) out << "," << r.phases[p];
+      out << "," << r.total << "\n";
+    }
+    return true;
+  }
+
+  bool writeJson(const std::string& filename) const
+  {
+    std::ofstream out(filename);
+    if (!out.is_open())
+    {
+      std::cerr << "Error opening file for writing: " << filename << std::endl;
+      return false;
+    }
+
+    out << std::fixed << std::setprecision(0);
+    out << "{\n  \"frames\": " << frames << ",\n  \"summary\": {";
+    for (int p = 0; p <= PHASE_COUNT; p++)
+    {
+      std::vector<double> samples;
+      for (size_t i = 0; i < size(); i++) samples.push_back(p == PHASE_COUNT ? at(i).total : at(i).phases[p]);
+      std::sort(samples.begin(), samples.end());
+      out << (p ? ", " : "") << "\"" << (p == PHASE_COUNT ? "total" : phaseName(p)) << "\": {\"mean_ns\": "
+          << average(p, size()) << ", \"p50_ns\": " << percentile(samples, 0.5)
+          << ", \"p99_ns\": " << percentile(samples, 0.99) << ", \"max_ns\": " << (samples.empty() ? 0 : samples.back()) << "}";
+    }
+    out << "},\n  \"records\": [\n";
+    for (size_t i = 0; i < size(); i++)
+    {
+      const FrameRecord& r = at(i);
+      out << "    {\"frame\": " << r.frame << ", \"steps\": " << r.steps;
+      for (int p = 0; p < PHASE_COUNT; p++) out << ", \"" << phaseName(p) << "_ns\": " << r.phases[p];
+      out << ", \"total_ns\": " << r.total << "}" << (i + 1 < size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return true;
+  }
+
+  // Writes a .json file if the name ends with .json, a .csv file otherwise
+  bool write(const std::string& filename) const
+  {
+    const std::string json = ".json";
+    if (filename.size() >= json.size() && filename.compare(filename.size() - json.size(), json.size(), json) == 0)
+    {
+      return writeJson(filename);
+    }
+    return writeCsv(filename);
+  }
+
+private:
+  void endFrame(Clock::time_point now)
+  {
+    current.total = std::chrono::duration<double, std::nano>(now - frameStart).count();
+    records[frames % records.size()] = current;
+    frames++;
+  }
+
+  std::vector<FrameRecord> records;
+  FrameRecord current;
+  Clock::time_point frameStart;
+  long frames = 0;
+  bool inFrame = false;
+};
+
+/**
+ * Adds the time between its construction and destruction to a phase of the
+ * current frame. Does nothing if there are no stats to record to.
+ **/
+class ScopedTimer
+{
+public:
+  ScopedTimer(FrameStats* stats, FramePhase phase) : stats(stats), phase(phase)
+  {
+    if (stats) start = FrameStats::Clock::now();
+  }
+
+  ~ScopedTimer()
+  {
+    if (stats) stats->add(phase, std::chrono::duration<double, std::nano>(FrameStats::Clock::now() - start).count());
+  }
+
+private:
+  FrameStats* stats;
+  FramePhase phase;
+  FrameStats::Clock::time_point start;
+};
+
+/**
+ * A 3x5 pixel font for the HUD. Every glyph is 5 rows of 3 bits, the top row in
+ * the highest bits.
+ **/
+inline uint16_t hudGlyph(char c)
+{
+  static const uint16_t digits[10] = {
+    0x7B6F, 0x2C97, 0x73E7, 0x73CF, 0x5BC9, 0x79CF, 0x79EF, 0x7249, 0x7BEF, 0x7BCF
+  };
+  static const uint16_t letters[26] = {
+    0x2BED, 0x6BAE, 0x3923, 0x6B6E, 0x79A7, 0x79A4, 0x396B, 0x5BED, 0x7497, 0x126A,
+    0x5BAD, 0x4927, 0x5FED, 0x6B6D, 0x2B6A, 0x6BA4, 0x2B73, 0x6BAD, 0x388E, 0x7492,
+    0x5B6F, 0x5B6A, 0x5BFD, 0x5AAD, 0x5A92, 0x72A7
+  };
+  if (c >= '0' && c <= '9') return digits[c - '0'];
+  if (c >= 'A' && c <= 'Z') return letters[c - 'A'];
+  if (c >= 'a' && c <= 'z') return letters[c - 'a'];
+  switch (c)
+  {
+    case '.': return 0x0002;
+    case ':': return 0x0410;
+    case '-': return 0x01C0;
+    case '/': return 0x12A4;
+    case '%': return 0x52A5;
+  }
+  return 0;
+}
+
+/**
+ * Draws the timings of the last frames in the top left corner of the indexed
+ * screen, with the brightest and the darkest colour of the palette. The pixels
+ * covered by the HUD are saved first, restore() puts them back after the frame
+ * was presented, so the effects using the screen as their state are not disturbed.
+ **/
+class Hud
+{
+public:
+  void draw(Framebuffer& screen, const Palette& palette, const FrameStats& stats)
+  {
+    const size_t window = 60;
+    char lines[6][32];
+    double total = stats.average(PHASE_COUNT, window);
+    snprintf(lines[0], sizeof(lines[0]), "FPS %.1f", total > 0 ? 1e9 / total : 0.0);
+    snprintf(lines[1], sizeof(lines[1]), "UPD %.2f MS", stats.average(PHASE_UPDATE, window) / 1e6);
+    snprintf(lines[2], sizeof(lines[2]), "EXP %.2f MS", stats.average(PHASE_EXPAND, window) / 1e6);
+    snprintf(lines[3], sizeof(lines[3]), "CPY %.2f MS", stats.average(PHASE_COPY, window) / 1e6);
+    snprintf(lines[4], sizeof(lines[4]), "PRS %.2f MS", stats.average(PHASE_PRESENT, window) / 1e6);
+    snprintf(lines[5], sizeof(lines[5]), "WAIT %.2f MS", stats.average(PHASE_WAIT, window) / 1e6);
+
+    // The brightest colour for the text, the darkest for the background
+    uint8_t ink = 0, paper = 0;
+    int brightest = -1, darkest = 1 << 30;
+    for (int i = 0; i < 256; i++)
+    {
+      int luma = palette[i].r * 2 + palette[i].g * 5 + palette[i].b;
+      if (luma > brightest) { brightest = luma; ink = i; }
+      if (luma < darkest) { darkest = luma; paper = i; }
+    }
+
+    scale = std::max(1, screen.height() / 300);
+    const int lineCount = 6;
+    rect.w = std::min(screen.width(), (4 * 15 + 1) * scale);
+    rect.h = std::min(screen.height(), (6 * lineCount + 2) * scale);
+    saved.resize(static_cast<size_t>(rect.w) * rect.h);
+    screen.markDirty(0, rect.h);
+    for (int y = 0; y < rect.h; y++)
+    {
+      memcpy(saved.data() + y * rect.w, screen.row(y), rect.w);
+      memset(screen.row(y), paper, rect.w);
+    }
+
+    for (int l = 0; l < lineCount; l++)
+    {
+      for (int c = 0; lines[l][c]; c++)
+      {
+        uint16_t glyph = hudGlyph(lines[l][c]);
+        for (int gy = 0; gy < 5; gy++)
+        {
+          for (int gx = 0; gx < 3; gx++)
+          {
+            if (!(glyph & (1 << ((4 - gy) * 3 + (2 - gx))))) continue;
+            for (int sy = 0; sy < scale; sy++)
+            {
+              for (int sx = 0; sx < scale; sx++)
+              {
+                int x = (1 + c * 4 + gx) * scale + sx;
+                int y = (1 + l * 6 + gy) * scale + sy;
+                if (x < rect.w && y < rect.h) screen.row(y)[x] = ink;
+              }
+            }
+          }
+        }
+      }
+    }
+    drawn = true;
+  }
+
+  void restore(Framebuffer& screen)
+  {
+    if (!drawn) return;
+    for (int y = 0; y < rect.h; y++)
+    {
+      memcpy(screen.row(y), saved.data() + y * rect.w, rect.w);
+    }
+    screen.markDirty(0, rect.h);
+    drawn = false;
+  }
+
+private:
+  struct { int w = 0, h = 0; } rect;
+  int scale = 1;
+  std::vector<uint8_t> saved;
+  bool drawn = false;
+};
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * The "virtual screen" every effect draws on. It holds one byte per pixel, every
+ * byte being an index into the 256 colour palette of the effect, like the Uint8*
+ * screen the programs of the series were allocating for themselves.
+ *
+ * Unlike that one, the screen is surrounded by guard bands, so the kernels can
+ * read (and write) a few pixels past every edge without checking the coordinates:
+ * GUARD_ROWS rows above and below it, and at least GUARD_COLUMNS bytes after the
+ * end of every row, which are also the ones before the start of the next row.
+ * The guard bands are 0 until something is drawn on them; what is drawn there is
+ * never shown, and clearGuards() resets them. Every row starts on a cache line,
+ * the rows are stride() bytes apart.
+ *
+ * The screen can also keep track of the rows which have changed since it was
+ * last shown, so the presenter only uploads those. This is for the effects which
+ * only change a part of the screen: they call trackDamage() once and markDirty()
+ * for the rows they draw on. For the others every row counts as changed.
+ *
+ * Every time the damage is cleared, the rows which had changed are stamped with
+ * the number of the frame, so a copy of the screen can later be brought up to
+ * date with only the rows changed since it was made.
+ **/
+class Framebuffer
+{
+public:
+  static const int GUARD_ROWS = 2;
+  static const int GUARD_COLUMNS = 16;
+  static const int ALIGNMENT = 64;
+
+  // The distance between the rows of a screen of the given width
+  static int strideFor(int width)
+  {
+    return (width + GUARD_COLUMNS + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  }
+
+  Framebuffer() = default;
+
+  Framebuffer(int width, int height)
+  {
+    resize(width, height);
+  }
+
+  /**
+   * Changes the size of the screen. The content, and the guard bands, are reset to 0.
+   **/
+  void resize(int width, int height)
+  {
+    w = width;
+    h = height;
+    rowStride = strideFor(w);
+    lines.assign(static_cast<size_t>(rowStride / ALIGNMENT) * (h + 2 * GUARD_ROWS), CacheLine{});
+    dirty.assign(h, 1);
+    dirtyRows = h;
+    changed.assign(h, generation);
+    copiedFrom = 0;
+
+    // Copies made from the screen before have nothing in common with it any more
+    static std::atomic<uint64_t> screens{0};
+    identity = ++screens;
+  }
+
+  /**
+   * Resets all the pixels, and the guard bands, to colour 0
+   **/
+  void clear()
+  {
+    memset(lines.data(), 0, lines.size() * sizeof(CacheLine));
+    markDirty(0, h);
+  }
+
+  // Resets the guard bands to 0, for the kernels which draw on them
+  void clearGuards()
+  {
+    uint8_t* top = row(-GUARD_ROWS);
+    memset(top, 0, static_cast<size_t>(GUARD_ROWS) * rowStride);
+    memset(row(h), 0, static_cast<size_t>(GUARD_ROWS) * rowStride);
+    for (int y = 0; y < h; y++)
+    {
+      memset(row(y) + w, 0, rowStride - w);
+    }
+  }
+
+  /**
+   * Makes this screen a copy of the other one, with the same size, pixels and
+   * changed rows. If this screen is already a copy of the other one, only the
+   * rows changed since (in either of them) are copied: a screen whose palette is
+   * all that moves costs nothing.
+   **/
+  void copyFrom(const Framebuffer& other)
+  {
+    if (w != other.w || h != other.h)
+    {
+      resize(other.w, other.h);
+    }
+
+    if (copiedFrom != other.identity || !other.tracking)
+    {
+      lines = other.lines;
+    }
+    else
+    {
+      for (int y = 0; y < h; y++)
+      {
+        if (dirty[y] || other.dirty[y] || other.changed[y] >= copiedGeneration)
+        {
+          memcpy(row(y), other.row(y), w);
+        }
+      }
+    }
+    copiedFrom = other.identity;
+    copiedGeneration = other.generation;
+
+    tracking = other.tracking;
+    dirty = other.dirty;
+    dirtyRows = other.dirtyRows;
+  }
+
+  // From now on only the rows given to markDirty() count as changed
+  void trackDamage(bool enable = true)
+  {
+    // What has changed before is not known, so all of it counts as changed
+    if (enable && !tracking) markDirty(0, h);
+    tracking = enable;
+  }
+  bool tracksDamage() const { return tracking; }
+
+  // The rows [firstRow, lastRow) have changed
+  void markDirty(int firstRow, int lastRow)
+  {
+    for (int y = std::max(0, firstRow); y < std::min(h, lastRow); y++)
+    {
+      dirtyRows += !dirty[y];
+      dirty[y] = 1;
+    }
+  }
+
+  // Called once the screen has been shown: no row has changed since
+  void clearDamage()
+  {
+    if (dirtyRows > 0)
+    {
+      for (int y = 0; y < h; y++)
+      {
+        if (dirty[y]) changed[y] = generation;
+      }
+      std::fill(dirty.begin(), dirty.end(), 0);
+      dirtyRows = 0;
+    }
+    generation++;
+  }
+
+  bool rowDirty(int y) const { return !tracking || dirty[y]; }
+  int dirtyRowCount() const { return tracking ? dirtyRows : h; }
+
+  // The row y of the screen, 64 byte aligned; the rows of the guard bands (-GUARD_ROWS..-1, h..h+GUARD_ROWS-1) can be asked for too
+  uint8_t* row(int y) { return reinterpret_cast<uint8_t*>(lines.data()) + static_cast<ptrdiff_t>(y + GUARD_ROWS) * rowStride; }
+  const uint8_t* row(int y) const { return reinterpret_cast<const uint8_t*>(lines.data()) + static_cast<ptrdiff_t>(y + GUARD_ROWS) * rowStride; }
+
+  // The pixels, within the screen or the guard bands around it
+  uint8_t getPixel(int x, int y) const { return row(y)[x]; }
+  void putPixel(int x, int y, uint8_t c) { row(y)[x] = c; }
+
+  int width() const { return w; }
+  int height() const { return h; }
+  int stride() const { return rowStride; }
+
+  // The number of visible pixels of the screen
+  size_t size() const { return static_cast<size_t>(w) * h; }
+
+private:
+  struct alignas(ALIGNMENT) CacheLine
+  {
+    uint8_t bytes[ALIGNMENT];
+  };
+
+  int w = 0;
+  int h = 0;
+  int rowStride = 0;
+  std::vector<CacheLine> lines;     // The screen and its guard bands, a whole number of cache lines per row
+
+  bool tracking = false;
+  std::vector<uint8_t> dirty;       // One flag per row, set if it has changed since the screen was shown
+  int dirtyRows = 0;
+  std::vector<uint32_t> changed;    // The frame every row has last changed in
+  uint32_t generation = 0;          // The number of times the damage was cleared
+  uint64_t identity = 0;            // Tells the screens apart, a new one is given by every resize
+  uint64_t copiedFrom = 0;          // The screen this one is a copy of, made at its copiedGeneration
+  uint32_t copiedGeneration = 0;
+};
+
+/**
+ * Scales src onto dst, nearest neighbour. The column of src is stepped along
+ * without a division (or a table, which would be allocated every frame):
+ * x * src.width() == column * dst.width() + remainder.
+ **/
+inline void scaleNearest(const Framebuffer& src, Framebuffer& dst)
+{
+  for (int y = 0; y < dst.height(); y++)
+  {
+    const uint8_t* from = src.row(static_cast<int>(static_cast<long>(y) * src.height() / dst.height()));
+    uint8_t* to = dst.row(y);
+    int column = 0;
+    int remainder = 0;
+    for (int x = 0; x < dst.width(); x++)
+    {
+      to[x] = from[column];
+      remainder += src.width();
+      while (remainder >= dst.width())
+      {
+        remainder -= dst.width();
+        column++;
+      }
+    }
+  }
+}
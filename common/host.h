@@ -0,0 +1,482 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "effect.h"
+#include "effect_seeker.h"
+#include "frame_pipeline.h"
+#include "frame_recorder.h"
+#include "frame_stats.h"
+#include "framebuffer.h"
+#include "presenter.h"
+#include "resolution_governor.h"
+#include "scheduler.h"
+#include "thread_pool.h"
+#include "upscale.h"
+
+/**
+ * The settings of the main loop, usually coming from the command line
+ **/
+struct HostOptions
+{
+  bool headless = false;                                      // Use the null presenter instead of a window
+  int width = 0;                                              // The size of the screen, 0 uses the size the effect was written for
+  int height = 0;
+  bool fullscreen = false;                                    // Open a window covering the whole display, at its resolution
+  long frames = 0;                                            // Stop after this many frames, 0 runs until the window is closed
+  double start = 0;                                           // Start this many seconds into the effect
+  bool throttle = true;                                       // Keep the update rate, otherwise calculate frames as fast as possible
+  double rate = 0;                                            // Frames per second to calculate, 0 uses the rate of the effect
+  int maxSkip = 4;                                            // At most this many frames are skipped when the machine cannot keep up
+  bool vsync = false;                                         // Synchronize the presentation with the refresh of the display
+  bool pipeline = false;                                      // Calculate the next frame on another thread while presenting this one
+  double targetFps = 0;                                       // Lower the resolution to keep this frame rate, 0 keeps the resolution
+  UpscaleFilter upscale = UPSCALE_NONE;                       // Enlarge the small frames on the CPU, with this filter
+  int pixelSize = 1;                                          // Draw the effects at 1 / pixelSize of the window in both directions
+  unsigned seed = static_cast<unsigned>(time(nullptr));       // The seed of the random number generator
+  int threads = 0;                                            // Threads calculating the effects, 0 uses all the cores
+  bool hugePages = true;                                      // Back the buffers of the effects by transparent huge pages
+  bool hud = false;                                           // Show the timings of the frames on the screen
+  std::string statsFile;                                      // Dump the timings of the last frames to this CSV or JSON file
+  std::string recordFile;                                     // Record the frames into this .y4m (or raw RGB) file
+};
+
+/**
+ * Fills the options from the command line. Returns false (after printing the usage)
+ * if something was not understood.
+ **/
+inline bool parseHostOptions(int argc, char* argv[], HostOptions& options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--headless")
+    {
+      options.headless = true;
+    }
+    else if (arg == "--width" && i + 1 < argc)
+    {
+      options.width = std::atoi(argv[++i]);
+    }
+    else if (arg == "--height" && i + 1 < argc)
+    {
+      options.height = std::atoi(argv[++i]);
+    }
+    else if (arg == "--fullscreen")
+    {
+      options.fullscreen = true;
+    }
+    else if (arg == "--no-throttle")
+    {
+      options.throttle = false;
+    }
+    else if (arg == "--vsync")
+    {
+      options.vsync = true;
+    }
+    else if (arg == "--pipeline")
+    {
+      options.pipeline = true;
+    }
+    else if (arg == "--target-fps" && i + 1 < argc)
+    {
+      options.targetFps = std::atof(argv[++i]);
+    }
+    else if (arg == "--upscale" && i + 1 < argc && parseUpscaleFilter(argv[i + 1], options.upscale))
+    {
+      i++;
+    }
+    else if (arg == "--pixel-size" && i + 1 < argc)
+    {
+      options.pixelSize = std::max(1, std::atoi(argv[++i]));
+    }
+    else if (arg == "--frames" && i + 1 < argc)
+    {
+      options.frames = std::atol(argv[++i]);
+    }
+    else if (arg == "--start" && i + 1 < argc)
+    {
+      options.start = std::atof(argv[++i]);
+    }
+    else if (arg == "--rate" && i + 1 < argc)
+    {
+      options.rate = std::atof(argv[++i]);
+    }
+    else if (arg == "--max-skip" && i + 1 < argc)
+    {
+      options.maxSkip = std::atoi(argv[++i]);
+    }
+    else if (arg == "--threads" && i + 1 < argc)
+    {
+      options.threads = std::atoi(argv[++i]);
+    }
+    else if (arg == "--no-huge-pages")
+    {
+      options.hugePages = false;
+    }
+    else if (arg == "--hud")
+    {
+      options.hud = true;
+    }
+    else if (arg == "--stats" && i + 1 < argc)
+    {
+      options.statsFile = argv[++i];
+    }
+    else if (arg == "--record" && i + 1 < argc)
+    {
+      options.recordFile = argv[++i];
+    }
+    else if (arg == "--seed" && i + 1 < argc)
+    {
+      options.seed = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    }
+    else
+    {
+      std::cerr << "Usage: " << argv[0] << " [--headless] [--width W] [--height H] [--fullscreen] [--frames N] [--start SECONDS] [--seed N] [--rate HZ] [--max-skip N] [--vsync] [--pipeline] [--target-fps HZ] [--upscale nearest|bilinear] [--pixel-size N] [--no-throttle] [--threads N] [--no-huge-pages] [--hud] [--stats FILE] [--record FILE]" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Gives the effect a screen of the new size, if it can draw at other sizes than
+ * the one it was written for. Otherwise the screen stays as it is, and the
+ * presenter scales it to the window. Returns true if the screen was resized.
+ **/
+inline bool resizeScreen(Effect& effect, Framebuffer& screen, int width, int height)
+{
+  // Minimized windows and the like are not worth a screen of their own
+  const int MIN_SIZE = 16;
+  if (width < MIN_SIZE || height < MIN_SIZE || (width == screen.width() && height == screen.height()))
+  {
+    return false;
+  }
+
+  Framebuffer resized(width, height);
+  resized.trackDamage(screen.tracksDamage());
+  if (!effect.resize(resized))
+  {
+    return false;
+  }
+  screen = std::move(resized);
+  return true;
+}
+
+// The size of the screen for a window of the given size, with pixels of pixelSize x pixelSize
+inline void screenSizeForWindow(int pixelSize, int& width, int& height)
+{
+  if (pixelSize > 1)
+  {
+    width = std::max(16, width / pixelSize);
+    height = std::max(16, height / pixelSize);
+  }
+}
+
+/**
+ * Tells whether the screen needs another size: the window was resized, or the
+ * governor (if any) wants another resolution after the frame just finished.
+ * Called once per frame, after stats.beginFrame().
+ **/
+inline bool screenSizeRequested(Presenter& presenter, ResolutionGovernor* governor, const FrameStats& stats, int pixelSize, int& width, int& height)
+{
+  bool requested = presenter.resizeRequested(width, height);
+  if (requested)
+  {
+    screenSizeForWindow(pixelSize, width, height);
+  }
+  if (governor)
+  {
+    if (requested)
+    {
+      // The screen keeps its scale of the window
+      governor->setOutputSize(width, height);
+      governor->size(width, height);
+    }
+    if (stats.size() > 0 && governor->frameDone(stats.at(stats.size() - 1), width, height))
+    {
+      requested = true;
+    }
+  }
+  return requested;
+}
+
+// Shows the screen, with the layers over it if the effect has any
+inline void presentFrame(Presenter& presenter, const Framebuffer& screen, const Palette& palette, const std::vector<Layer>& layers)
+{
+  if (layers.empty())
+  {
+    presenter.present(screen, palette);
+  }
+  else
+  {
+    presenter.presentLayers(screen, palette, layers);
+  }
+}
+
+/**
+ * The serial main loop: calculate the frames which are due, present the last
+ * one, and repeat until the user closes the window or the effect has finished.
+ **/
+inline void runSerialLoop(Effect& effect, Presenter& presenter, const HostOptions& options,
+                          Framebuffer& screen, FrameScheduler& scheduler, FrameStats& stats, FrameRecorder& recorder,
+                          ResolutionGovernor* governor)
+{
+  Hud hud;
+  long frame = 0;
+  bool running = true;
+  while (running && !presenter.quitRequested())
+  {
+    stats.beginFrame();
+
+    int width, height;
+    if (screenSizeRequested(presenter, governor, stats, options.pixelSize, width, height))
+    {
+      resizeScreen(effect, screen, width, height);
+    }
+
+    int steps;
+    {
+      ScopedTimer timer(&stats, PHASE_WAIT);
+      steps = scheduler.beginFrame();
+    }
+    stats.setSteps(steps);
+
+    bool last = false;
+    {
+      // let's calculate the next frame(s) of the effect and draw them on the virtual screen
+      ScopedTimer timer(&stats, PHASE_UPDATE);
+      for (int i = 0; i < steps && running && !last; i++)
+      {
+        running = effect.update(screen);
+        last = running && options.frames > 0 && ++frame >= options.frames;
+      }
+    }
+
+    if (running)
+    {
+      if (recorder.isOpen()) recorder.record(screen, effect.palette(), effect.layers());
+      if (options.hud) hud.draw(screen, effect.palette(), stats);
+      presentFrame(presenter, screen, effect.palette(), effect.layers());
+      screen.clearDamage();
+      if (options.hud) hud.restore(screen);
+    }
+    running = running && !last;
+  }
+}
+
+/**
+ * The pipelined main loop: a simulation thread calculates the frames on the
+ * screen of the effect and copies each finished one into a FramePipeline, while
+ * this thread presents the previous one. A frame then costs about the longer of
+ * the calculation and the presentation, instead of their sum.
+ *
+ * The effect keeps drawing on its own screen, as most of them need the previous
+ * frame to calculate the next one. The presentation side owns the frame it got
+ * from the pipeline, so the HUD is drawn straight onto it.
+ *
+ * In the stats the wait is how long the presentation waited for a frame, and the
+ * update is how long the simulation spent on that frame, in parallel.
+ **/
+inline void runPipelinedLoop(Effect& effect, Presenter& presenter, const HostOptions& options,
+                             Framebuffer& screen, FrameScheduler& scheduler, FrameStats& stats, FrameRecorder& recorder,
+                             ResolutionGovernor* governor)
+{
+  typedef std::chrono::steady_clock Clock;
+
+  FramePipeline pipeline;
+  pipeline.resize(screen.width(), screen.height());
+  std::atomic<bool> stop(false);
+
+  // A new size for the screen, width in the high half, height in the low one, 0 if none
+  std::atomic<uint64_t> requestedSize(0);
+
+  std::thread simulation([&] {
+    long frame = 0;
+    bool running = true;
+    while (running && !stop.load(std::memory_order_relaxed))
+    {
+      PipelineFrame* slot;
+      for (int spins = 0; !(slot = pipeline.tryBeginWrite()); pipelineBackoff(spins))
+      {
+        if (stop.load(std::memory_order_relaxed)) return;
+      }
+
+      int steps = scheduler.beginFrame();
+      Clock::time_point start = Clock::now();
+
+      uint64_t size = requestedSize.exchange(0, std::memory_order_relaxed);
+      if (size)
+      {
+        resizeScreen(effect, screen, static_cast<int>(size >> 32), static_cast<int>(size & 0xFFFFFFFF));
+      }
+
+      bool last = false;
+      for (int i = 0; i < steps && running && !last; i++)
+      {
+        running = effect.update(screen);
+        last = running && options.frames > 0 && ++frame >= options.frames;
+      }
+
+      slot->steps = steps;
+      slot->updateNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+      slot->last = last;
+      slot->finished = !running;
+      if (running)
+      {
+        // The rows changed since the last frame go along, the presenter only uploads those
+        slot->screen.copyFrom(screen);
+        screen.clearDamage();
+        slot->palette = effect.palette();
+        slot->layers.copyFrom(effect.layers());
+      }
+      pipeline.endWrite();
+      running = running && !last;
+    }
+  });
+
+  Hud hud;
+  bool running = true;
+  while (running && !presenter.quitRequested())
+  {
+    stats.beginFrame();
+
+    int width, height;
+    if (screenSizeRequested(presenter, governor, stats, options.pixelSize, width, height))
+    {
+      requestedSize.store(static_cast<uint64_t>(width) << 32 | static_cast<uint32_t>(height), std::memory_order_relaxed);
+    }
+
+    PipelineFrame* slot;
+    {
+      // Keep the window responsive while the simulation is busy with a slow frame
+      ScopedTimer timer(&stats, PHASE_WAIT);
+      for (int spins = 0; !(slot = pipeline.tryBeginRead()) && !presenter.quitRequested(); pipelineBackoff(spins))
+      {
+      }
+    }
+    if (!slot) break;
+
+    stats.setSteps(slot->steps);
+    stats.add(PHASE_UPDATE, slot->updateNs);
+
+    if (!slot->finished)
+    {
+      if (recorder.isOpen()) recorder.record(slot->screen, slot->palette, slot->layers.layers());
+      if (options.hud) hud.draw(slot->screen, slot->palette, stats);
+      presentFrame(presenter, slot->screen, slot->palette, slot->layers.layers());
+    }
+    running = !slot->finished && !slot->last;
+    pipeline.endRead();
+  }
+
+  stop.store(true, std::memory_order_relaxed);
+  simulation.join();
+}
+
+/**
+ * The main loop shared by all the effects: sets up the screen, the presenter
+ * and the effect, then runs the frames serially or pipelined, as requested.
+ **/
+inline int runEffect(Effect& effect, Presenter& presenter, const HostOptions& options)
+{
+  srand(options.seed);
+  if (options.threads > 0)
+  {
+    setThreadCount(options.threads);
+  }
+  Arena::useHugePages(options.hugePages);
+
+  // This will be the actual screen on which the effect performs the drawing
+  int width = options.width > 0 ? options.width : effect.width();
+  int height = options.height > 0 ? options.height : effect.height();
+  int screenWidth = width, screenHeight = height;
+  screenSizeForWindow(options.pixelSize, screenWidth, screenHeight);
+  Framebuffer screen(screenWidth, screenHeight);
+  bool resizable = effect.resize(screen);
+  if (!resizable)
+  {
+    std::cerr << effect.title() << " can only be drawn at " << effect.width() << "x" << effect.height() << ", it will be scaled" << std::endl;
+    screen.resize(effect.width(), effect.height());
+    effect.resize(screen);
+  }
+
+  if (!presenter.open(effect.title(), width, height))
+  {
+    return EXIT_FAILURE;
+  }
+
+  if (!effect.init(screen))
+  {
+    presenter.close();
+    return EXIT_FAILURE;
+  }
+
+  // The effects drawing their frames on their own start there at once, the others are run up to it unseen
+  if (options.start > 0)
+  {
+    EffectSeeker seeker(0);
+    seeker.start(effect, screen);
+    if (!seeker.seek(effect, screen, effect.frameAt(options.start)))
+    {
+      std::cerr << "Cannot start " << effect.title() << " at " << options.start << " s" << std::endl;
+      presenter.close();
+      return EXIT_FAILURE;
+    }
+  }
+
+  double rate = !options.throttle ? 0 : options.rate > 0 ? options.rate : effect.updateRate();
+  FrameScheduler scheduler(rate, options.maxSkip + 1, options.vsync);
+
+  // The frames are recorded at the size the effect starts with, and at its rate even when not throttled
+  FrameRecorder recorder;
+  if (!options.recordFile.empty() &&
+      !recorder.open(options.recordFile, screen.width(), screen.height(), options.rate > 0 ? options.rate : effect.updateRate()))
+  {
+    presenter.close();
+    return EXIT_FAILURE;
+  }
+
+  // The resolution can only be lowered for the effects which can be drawn at any size
+  std::unique_ptr<ResolutionGovernor> governor;
+  if (options.targetFps > 0 && resizable)
+  {
+    governor = std::make_unique<ResolutionGovernor>(options.targetFps, screen.width(), screen.height());
+  }
+
+  FrameStats stats;
+  presenter.setFrameStats(&stats);
+
+  if (options.pipeline)
+  {
+    runPipelinedLoop(effect, presenter, options, screen, scheduler, stats, recorder, governor.get());
+  }
+  else
+  {
+    runSerialLoop(effect, presenter, options, screen, scheduler, stats, recorder, governor.get());
+  }
+
+  recorder.close();
+
+  stats.finish();
+  presenter.setFrameStats(nullptr);
+
+  if (!options.statsFile.empty())
+  {
+    stats.write(options.statsFile);
+  }
+
+  presenter.close();
+  return EXIT_SUCCESS;
+}
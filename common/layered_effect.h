@@ -0,0 +1,199 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "effect.h"
+#include "framebuffer.h"
+
+/**
+ * How an effect of a LayeredEffect is shown over the ones below it. The colours
+ * left out are the transparent colours of the effect.
+ **/
+struct LayerSettings
+{
+  BlendMode mode = BLEND_COLOUR_KEY;
+  uint8_t alpha = 255;
+};
+
+/**
+ * Several effects drawn over each other, a scroller over a tunnel or a fire over
+ * a plasma. The first effect draws on the screen, the others on screens of their
+ * own shown as layers over it, each with its palette and its LayerSettings. The
+ * presenter blends them together (see Compositor), the effects know nothing of
+ * each other.
+ *
+ * The scene has the size and the rate of the first effect, and goes on as long
+ * as it does. The other effects are updated at their own rates within it, and
+ * keep showing their last frame once they have finished. The effects which can
+ * only be drawn at their own size are drawn on a screen of that size, scaled to
+ * the one of the scene.
+ **/
+class LayeredEffect : public Effect
+{
+public:
+  LayeredEffect(std::unique_ptr<Effect> base, std::vector<std::pair<std::unique_ptr<Effect>, LayerSettings>> layered)
+  {
+    parts.emplace_back(std::move(base), LayerSettings());
+    for (auto& layer : layered)
+    {
+      parts.emplace_back(std::move(layer.first), layer.second);
+    }
+  }
+
+  const char* title() const override { return parts[0].effect->title(); }
+  int width() const override { return parts[0].effect->width(); }
+  int height() const override { return parts[0].effect->height(); }
+  double updateRate() const override { return parts[0].effect->updateRate(); }
+
+  bool resize(Framebuffer& screen) override
+  {
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+      Part& part = parts[i];
+      Framebuffer& scene = i == 0 ? screen : part.layer;
+      if (i > 0)
+      {
+        part.layer.resize(screen.width(), screen.height());
+      }
+      part.scaled = !part.effect->resize(scene);
+
+      // The screen of its own keeps what the effect has drawn, it is only made once
+      Framebuffer& own = part.own;
+      if (part.scaled && (own.width() != part.effect->width() || own.height() != part.effect->height()))
+      {
+        own.resize(part.effect->width(), part.effect->height());
+        part.effect->resize(own);
+      }
+      show(i, screen);
+    }
+    linkLayers();
+    return true;
+  }
+
+  bool init(Framebuffer& screen) override
+  {
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+      if (!parts[i].effect->init(target(i, screen)))
+      {
+        return false;
+      }
+      show(i, screen);
+    }
+    colours = parts[0].effect->palette();
+    return true;
+  }
+
+  bool update(Framebuffer& screen) override
+  {
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+      Part& part = parts[i];
+      Framebuffer& drawn = target(i, screen);
+      if (i > 0)
+      {
+        // The layers are copied (or shown) after every update, what has changed before is done with
+        drawn.clearDamage();
+      }
+
+      part.pending += part.effect->updateRate() / updateRate();
+      for (; part.pending >= 1 && !part.finished; part.pending -= 1)
+      {
+        part.finished = !part.effect->update(drawn);
+      }
+      show(i, screen);
+    }
+    colours = parts[0].effect->palette();
+    return !parts[0].finished;
+  }
+
+  /**
+   * The scene can be snapshotted if all its effects can. The screen of the first
+   * one is the one of the scene, the others are written with their effects. The
+   * palettes of the effects are not, they are set again by their updates.
+   **/
+  bool saveState(StateWriter& state) const override
+  {
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+      const Part& part = parts[i];
+      state.write(part.pending);
+      state.write(part.finished);
+      if (!part.effect->saveState(state))
+      {
+        return false;
+      }
+      if (i > 0) state.write(part.layer);
+      if (part.scaled) state.write(part.own);
+    }
+    return true;
+  }
+
+  bool loadState(StateReader& state) override
+  {
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+      Part& part = parts[i];
+      if (!state.read(part.pending) || !state.read(part.finished) || !part.effect->loadState(state))
+      {
+        return false;
+      }
+      if (i > 0 && !state.read(part.layer)) return false;
+      if (part.scaled && !state.read(part.own)) return false;
+      if (i > 0) part.layer.markDirty(0, part.layer.height());
+    }
+    return true;
+  }
+
+private:
+  struct Part
+  {
+    Part(std::unique_ptr<Effect> effect, const LayerSettings& settings) : effect(std::move(effect)), settings(settings) {}
+
+    std::unique_ptr<Effect> effect;
+    LayerSettings settings;
+    Framebuffer layer;            // The screen of the layer, at the size of the scene (unused for the first effect)
+    Framebuffer own;              // The screen of an effect drawn at its own size
+    bool scaled = false;          // The effect draws on its own screen, which is scaled to the scene
+    double pending = 0;           // The updates of the effect due, at its own rate
+    bool finished = false;
+  };
+
+  // The screen the effect i draws on
+  Framebuffer& target(size_t i, Framebuffer& screen)
+  {
+    return parts[i].scaled ? parts[i].own : i == 0 ? screen : parts[i].layer;
+  }
+
+  // Brings what the effect i has drawn to the size of the scene, if it draws at its own size
+  void show(size_t i, Framebuffer& screen)
+  {
+    if (parts[i].scaled)
+    {
+      scaleNearest(parts[i].own, i == 0 ? screen : parts[i].layer);
+    }
+  }
+
+  void linkLayers()
+  {
+    overlays.clear();
+    for (size_t i = 1; i < parts.size(); i++)
+    {
+      Layer layer;
+      layer.screen = &parts[i].layer;
+      layer.palette = &parts[i].effect->palette();
+      layer.mode = parts[i].settings.mode;
+      layer.alpha = parts[i].settings.alpha;
+      layer.transparent.reset();
+      for (uint8_t colour : parts[i].effect->transparentColours())
+      {
+        layer.transparent.set(colour);
+      }
+      overlays.push_back(layer);
+    }
+  }
+
+  std::vector<Part> parts;        // The first one is drawn on the screen, the others over it
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include "effect.h"
+
+/**
+ * A range of palette entries whose colours rotate, like the cycling ranges of
+ * the pictures painted for colour cycling: every range has a speed and a
+ * direction of its own
+ **/
+struct CycleRange
+{
+  int first = 0;              // The first and the last entry of the range, inclusive
+  int last = 255;
+  double speed = 1;           // Entries moved per update: positive moves the colours towards the first entry
+};
+
+/**
+ * Animates a palette by cycling ranges of it, without moving any colours around.
+ * The colours stay where they were put by setColours(); every range only keeps
+ * how far it has rotated, and the palette shown is looked up through that offset.
+ * Advancing costs nothing, and the palette is built in one pass over its entries,
+ * whatever the speeds (which can be fractions of an entry per update).
+ *
+ * The ranges are not supposed to overlap, the entries outside them never change.
+ **/
+class PaletteCycler
+{
+public:
+  // The colours of the palette before any cycling, which also resets the ranges to them
+  void setColours(const Palette& colours)
+  {
+    base = colours;
+    for (Range& range : ranges)
+    {
+      range.position = 0;
+    }
+  }
+
+  void addRange(const CycleRange& range)
+  {
+    ranges.push_back(Range{range, 0});
+  }
+
+  void clearRanges()
+  {
+    ranges.clear();
+  }
+
+  // Moves every range forward by the given number of updates
+  void advance(double updates = 1)
+  {
+    for (Range& range : ranges)
+    {
+      int size = range.cycle.last - range.cycle.first + 1;
+      range.position = std::fmod(range.position + range.cycle.speed * updates, size);
+      if (range.position < 0) range.position += size;
+    }
+  }
+
+  /**
+   * Writes the palette at the current offsets: the entry first + i of a range
+   * shows the colour first + (i + offset) % size of the original palette
+   **/
+  void apply(Palette& palette) const
+  {
+    palette = base;
+    for (const Range& range : ranges)
+    {
+      const int first = range.cycle.first;
+      const int size = range.cycle.last - first + 1;
+      const int offset = static_cast<int>(range.position);
+      for (int i = 0, from = offset; i < size; i++, from = from + 1 < size ? from + 1 : 0)
+      {
+        palette[first + i] = base[first + from];
+      }
+    }
+  }
+
+  // How far the ranges have rotated, for the snapshots of the effects (the colours and the ranges are set up by init())
+  void saveState(StateWriter& state) const
+  {
+    for (const Range& range : ranges)
+    {
+      state.write(range.position);
+    }
+  }
+
+  bool loadState(StateReader& state)
+  {
+    for (Range& range : ranges)
+    {
+      if (!state.read(range.position))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  struct Range
+  {
+    CycleRange cycle;
+    double position;          // How many entries the range has rotated by, 0 <= position < its size
+  };
+
+  Palette base = defaultPalette();
+  std::vector<Range> ranges;
+};
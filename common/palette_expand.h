@@ -0,0 +1,268 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unistd.h>
+
+#include "cpu_dispatch.h"
+#include "effect.h"
+
+/**
+ * The palette of an effect in the form of a lookup table giving the 32 bit ARGB8888
+ * value of every colour index. Alpha is always 255: the 8 bit surfaces the effects
+ * were shown with never had any transparency either.
+ **/
+struct PaletteLut
+{
+  alignas(64) uint32_t argb[256];
+};
+
+inline void buildPaletteLut(const Palette& palette, PaletteLut& lut)
+{
+  for (size_t i = 0; i < palette.size(); i++)
+  {
+    lut.argb[i] = 0xFF000000u | (static_cast<uint32_t>(palette[i].r) << 16) |
+                  (static_cast<uint32_t>(palette[i].g) << 8) | palette[i].b;
+  }
+}
+
+/**
+ * The size of the last level cache, or a guess if the system does not tell
+ **/
+inline size_t lastLevelCacheBytes()
+{
+  static const size_t bytes = [] {
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    for (int level : {_SC_LEVEL3_CACHE_SIZE, _SC_LEVEL2_CACHE_SIZE})
+    {
+      long size = sysconf(level);
+      if (size > 0)
+      {
+        return static_cast<size_t>(size);
+      }
+    }
+#endif
+    return static_cast<size_t>(8) << 20;
+  }();
+  return bytes;
+}
+
+/**
+ * Whether the rows of a frame of that many bytes are expanded with non-temporal
+ * stores. A frame taking more than half of the last level cache (a texture,
+ * mostly) is evicted before it is read back anyway, and streaming it saves
+ * reading every line before writing it; a smaller one is better left in the
+ * cache for the copy to the GPU. The callers expand a row at a time, so they
+ * decide this once for the whole frame.
+ **/
+inline bool streamFrame(size_t bytes)
+{
+  return bytes > lastLevelCacheBytes() / 2;
+}
+
+/**
+ * Converts count indexed pixels to ARGB8888 through the lookup table, one pixel
+ * at a time. The stores are plain ones whatever stream says.
+ **/
+inline void expandPaletteScalar(const uint8_t* src, uint32_t* dst, size_t count, const PaletteLut& lut, bool stream)
+{
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    dst[i] = lut.argb[src[i]];
+    dst[i + 1] = lut.argb[src[i + 1]];
+    dst[i + 2] = lut.argb[src[i + 2]];
+    dst[i + 3] = lut.argb[src[i + 3]];
+  }
+  for (; i < count; i++)
+  {
+    dst[i] = lut.argb[src[i]];
+  }
+}
+
+#ifdef LXF_X86
+
+/**
+ * SSE2 has no gather, so the lookups stay scalar, but 16 pixels are read with one
+ * load and written with four 16 byte stores, non-temporal ones if stream is set
+ * (see streamFrame()).
+ **/
+inline void expandPaletteSse2(const uint8_t* src, uint32_t* dst, size_t count, const PaletteLut& lut, bool stream)
+{
+  const uint32_t* table = lut.argb;
+
+  // Scalar head, until the destination is 16 byte aligned
+  size_t i = 0;
+  while (i < count && (reinterpret_cast<uintptr_t>(dst + i) & 15) != 0)
+  {
+    dst[i] = table[src[i]];
+    i++;
+  }
+
+  for (; i + 16 <= count; i += 16)
+  {
+    __m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    alignas(16) uint8_t idx[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(idx), indices);
+
+    __m128i p0 = _mm_setr_epi32(table[idx[0]], table[idx[1]], table[idx[2]], table[idx[3]]);
+    __m128i p1 = _mm_setr_epi32(table[idx[4]], table[idx[5]], table[idx[6]], table[idx[7]]);
+    __m128i p2 = _mm_setr_epi32(table[idx[8]], table[idx[9]], table[idx[10]], table[idx[11]]);
+    __m128i p3 = _mm_setr_epi32(table[idx[12]], table[idx[13]], table[idx[14]], table[idx[15]]);
+
+    __m128i* out = reinterpret_cast<__m128i*>(dst + i);
+    if (stream)
+    {
+      _mm_stream_si128(out, p0);
+      _mm_stream_si128(out + 1, p1);
+      _mm_stream_si128(out + 2, p2);
+      _mm_stream_si128(out + 3, p3);
+    }
+    else
+    {
+      _mm_store_si128(out, p0);
+      _mm_store_si128(out + 1, p1);
+      _mm_store_si128(out + 2, p2);
+      _mm_store_si128(out + 3, p3);
+    }
+  }
+  if (stream)
+  {
+    _mm_sfence();
+  }
+
+  for (; i < count; i++)
+  {
+    dst[i] = table[src[i]];
+  }
+}
+
+/**
+ * AVX2 widens 8 indices at a time to 32 bits and fetches their colours with a
+ * single gather from the (L1 resident) lookup table.
+ **/
+__attribute__((target("avx2")))
+inline void expandPaletteAvx2(const uint8_t* src, uint32_t* dst, size_t count, const PaletteLut& lut, bool stream)
+{
+  const int* table = reinterpret_cast<const int*>(lut.argb);
+
+  // Scalar head, until the destination is 32 byte aligned
+  size_t i = 0;
+  while (i < count && (reinterpret_cast<uintptr_t>(dst + i) & 31) != 0)
+  {
+    dst[i] = lut.argb[src[i]];
+    i++;
+  }
+
+  for (; i + 32 <= count; i += 32)
+  {
+    __m256i p0 = _mm256_i32gather_epi32(table, _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i))), 4);
+    __m256i p1 = _mm256_i32gather_epi32(table, _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i + 8))), 4);
+    __m256i p2 = _mm256_i32gather_epi32(table, _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i + 16))), 4);
+    __m256i p3 = _mm256_i32gather_epi32(table, _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i + 24))), 4);
+
+    __m256i* out = reinterpret_cast<__m256i*>(dst + i);
+    if (stream)
+    {
+      _mm256_stream_si256(out, p0);
+      _mm256_stream_si256(out + 1, p1);
+      _mm256_stream_si256(out + 2, p2);
+      _mm256_stream_si256(out + 3, p3);
+    }
+    else
+    {
+      _mm256_store_si256(out, p0);
+      _mm256_store_si256(out + 1, p1);
+      _mm256_store_si256(out + 2, p2);
+      _mm256_store_si256(out + 3, p3);
+    }
+  }
+  if (stream)
+  {
+    _mm_sfence();
+  }
+
+  for (; i < count; i++)
+  {
+    dst[i] = lut.argb[src[i]];
+  }
+}
+
+/**
+ * AVX-512 does the same as AVX2 with 16 pixels per gather, and writes a whole
+ * cache line with every store.
+ **/
+__attribute__((target("avx512f")))
+inline void expandPaletteAvx512(const uint8_t* src, uint32_t* dst, size_t count, const PaletteLut& lut, bool stream)
+{
+  const int* table = reinterpret_cast<const int*>(lut.argb);
+
+  // Scalar head, until the destination is 64 byte aligned
+  size_t i = 0;
+  while (i < count && (reinterpret_cast<uintptr_t>(dst + i) & 63) != 0)
+  {
+    dst[i] = lut.argb[src[i]];
+    i++;
+  }
+
+  for (; i + 64 <= count; i += 64)
+  {
+    __m512i p0 = _mm512_i32gather_epi32(_mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))), table, 4);
+    __m512i p1 = _mm512_i32gather_epi32(_mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 16))), table, 4);
+    __m512i p2 = _mm512_i32gather_epi32(_mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 32))), table, 4);
+    __m512i p3 = _mm512_i32gather_epi32(_mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 48))), table, 4);
+
+    __m512i* out = reinterpret_cast<__m512i*>(dst + i);
+    if (stream)
+    {
+      _mm512_stream_si512(out, p0);
+      _mm512_stream_si512(out + 1, p1);
+      _mm512_stream_si512(out + 2, p2);
+      _mm512_stream_si512(out + 3, p3);
+    }
+    else
+    {
+      _mm512_store_si512(out, p0);
+      _mm512_store_si512(out + 1, p1);
+      _mm512_store_si512(out + 2, p2);
+      _mm512_store_si512(out + 3, p3);
+    }
+  }
+  if (stream)
+  {
+    _mm_sfence();
+  }
+
+  for (; i < count; i++)
+  {
+    dst[i] = lut.argb[src[i]];
+  }
+}
+
+#endif
+
+typedef void (*ExpandPaletteFunction)(const uint8_t* src, uint32_t* dst, size_t count, const PaletteLut& lut, bool stream);
+
+/**
+ * Picks the fastest expansion for the given tier, the one of the CPU by default
+ **/
+inline ExpandPaletteFunction selectExpandPalette(CpuTier tier = cpuTier())
+{
+#ifdef LXF_X86
+  if (tier >= CPU_AVX512) return expandPaletteAvx512;
+  if (tier >= CPU_AVX2) return expandPaletteAvx2;
+  if (tier >= CPU_SSE2) return expandPaletteSse2;
+#endif
+  return expandPaletteScalar;
+}
+
+/**
+ * Converts count indexed pixels to ARGB8888 through the lookup table, with the
+ * best implementation for the current CPU. stream is for the rows of frames
+ * which are only written, see streamFrame().
+ **/
+inline void expandPalette(const uint8_t* src, uint32_t* dst, size_t count, const PaletteLut& lut, bool stream = false)
+{
+  static const ExpandPaletteFunction expand = selectExpandPalette();
+  expand(src, dst, count, lut, stream);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vector>
+
+#include "effect.h"
+#include "frame_stats.h"
+#include "framebuffer.h"
+
+/**
+ * A presenter takes the frames calculated by the effect and shows them somewhere.
+ **/
+class Presenter
+{
+public:
+  virtual ~Presenter() = default;
+
+  // Prepares an output of the given size, in pixels. Returns false on failure.
+  virtual bool open(const char* title, int width, int height) = 0;
+
+  // Processes the pending events and tells whether the user wants to leave
+  virtual bool quitRequested() = 0;
+
+  /**
+   * Tells whether the output has changed its size (the window was resized, for
+   * example) since the last call, and if so, the new size in pixels
+   **/
+  virtual bool resizeRequested(int& width, int& height) { return false; }
+
+  // Shows the given screen with the given palette. The size of the screen can change between the calls.
+  virtual void present(const Framebuffer& screen, const Palette& palette) = 0;
+
+  /**
+   * Shows the given screen with the layers of the effect over it. The presenters
+   * which do not composite show the screen alone.
+   **/
+  virtual void presentLayers(const Framebuffer& screen, const Palette& palette, const std::vector<Layer>& layers)
+  {
+    present(screen, palette);
+  }
+
+  // Releases everything allocated by open()
+  virtual void close() {}
+
+  // The presenter adds the time of its phases to the current frame of these stats
+  void setFrameStats(FrameStats* frameStats) { stats = frameStats; }
+
+protected:
+  FrameStats* stats = nullptr;
+};
+
+/**
+ * A presenter which throws the frames away. Used to run the effects on machines
+ * without a display and to measure the cost of the effect alone.
+ **/
+class NullPresenter : public Presenter
+{
+public:
+  bool open(const char*, int, int) override { return true; }
+  bool quitRequested() override { return false; }
+  void present(const Framebuffer&, const Palette&) override { frames++; }
+
+  long presentedFrames() const { return frames; }
+
+private:
+  long frames = 0;
+};
+
+/**
+ * A presenter keeping a copy of the last frame and its palette in memory, so it
+ * can be inspected after the effect has run.
+ **/
+class OffscreenPresenter : public Presenter
+{
+public:
+  bool open(const char*, int width, int height) override
+  {
+    frame.resize(width, height);
+    return true;
+  }
+
+  bool quitRequested() override { return false; }
+
+  void present(const Framebuffer& screen, const Palette& palette) override
+  {
+    frame.copyFrom(screen);
+    colours = palette;
+    frames++;
+  }
+
+  const Framebuffer& lastFrame() const { return frame; }
+  const Palette& lastPalette() const { return colours; }
+  long presentedFrames() const { return frames; }
+
+private:
+  Framebuffer frame;
+  Palette colours = defaultPalette();
+  long frames = 0;
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <cstdint>
+
+#include "cpu_dispatch.h"
+
+/**
+ * 128 random bits, as returned by CounterRandom
+ **/
+struct RandomBits
+{
+  uint32_t word[4];
+
+  // The i-th bit (0..127) and the i-th byte (0..15) of the bits
+  bool bit(int i) const { return (word[i >> 5] >> (i & 31)) & 1; }
+  uint8_t byte(int i) const { return static_cast<uint8_t>(word[i >> 2] >> ((i & 3) * 8)); }
+};
+
+/**
+ * Maps a random byte to 0..9, for the effects written with rand() % 10
+ **/
+inline int randomTenth(uint8_t byte)
+{
+  return (byte * 10) >> 8;
+}
+
+/**
+ * The Philox4x32-10 generator (Salmon et al., "Parallel random numbers: as easy
+ * as 1, 2, 3"): the counter is encrypted with the key by ten rounds of multiplies
+ * and xors, which gives 128 bits passing BigCrush for every counter.
+ **/
+inline RandomBits philox4x32(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t k0, uint32_t k1)
+{
+  for (int round = 0; round < 10; round++)
+  {
+    uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c0;
+    uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c2;
+    uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+    uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+    c1 = static_cast<uint32_t>(p1);
+    c3 = static_cast<uint32_t>(p0);
+    c0 = n0;
+    c2 = n2;
+    k0 += 0x9E3779B9u;
+    k1 += 0xBB67AE85u;
+  }
+  return RandomBits{{c0, c1, c2, c3}};
+}
+
+/**
+ * The bits of count counters in a row, (c0, c1 + i, c2, c3) for i in [0, count),
+ * the way the effects ask for the pixels of a column. The vectorized versions
+ * run a counter in every lane and give the same bits as philox4x32().
+ **/
+typedef void (*PhiloxColumnFunction)(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t k0, uint32_t k1, int count, RandomBits* bits);
+
+inline void philoxColumnScalar(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t k0, uint32_t k1, int count, RandomBits* bits)
+{
+  for (int i = 0; i < count; i++)
+  {
+    bits[i] = philox4x32(c0, c1 + i, c2, c3, k0, k1);
+  }
+}
+
+#ifdef LXF_X86
+
+// The high and the low halves of the 64 bit products of the lanes of a with m
+__attribute__((target("avx2")))
+inline void mulHiLoAvx2(__m256i a, __m256i m, __m256i& hi, __m256i& lo)
+{
+  __m256i even = _mm256_mul_epu32(a, m);
+  __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+  lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+  hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+/**
+ * Eight counters at a time. The multiplies give four 64 bit products per
+ * instruction, the odd lanes are shifted into the even ones for the other four.
+ * (With SSE2 there would be only two, which is slower than the scalar version.)
+ **/
+__attribute__((target("avx2")))
+inline void philoxColumnAvx2(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t k0, uint32_t k1, int count, RandomBits* bits)
+{
+  const __m256i m0 = _mm256_set1_epi32(static_cast<int>(0xD2511F53u));
+  const __m256i m1 = _mm256_set1_epi32(static_cast<int>(0xCD9E8D57u));
+
+  int i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256i x0 = _mm256_set1_epi32(static_cast<int>(c0));
+    __m256i x1 = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(c1 + i)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256i x2 = _mm256_set1_epi32(static_cast<int>(c2));
+    __m256i x3 = _mm256_set1_epi32(static_cast<int>(c3));
+    uint32_t key0 = k0, key1 = k1;
+    for (int round = 0; round < 10; round++)
+    {
+      __m256i hi0, lo0, hi1, lo1;
+      mulHiLoAvx2(x0, m0, hi0, lo0);
+      mulHiLoAvx2(x2, m1, hi1, lo1);
+      x0 = _mm256_xor_si256(_mm256_xor_si256(hi1, x1), _mm256_set1_epi32(static_cast<int>(key0)));
+      x2 = _mm256_xor_si256(_mm256_xor_si256(hi0, x3), _mm256_set1_epi32(static_cast<int>(key1)));
+      x1 = lo1;
+      x3 = lo0;
+      key0 += 0x9E3779B9u;
+      key1 += 0xBB67AE85u;
+    }
+
+    // Transposed within the 128 bit halves, then the halves put in order
+    __m256i t0 = _mm256_unpacklo_epi32(x0, x1);
+    __m256i t1 = _mm256_unpacklo_epi32(x2, x3);
+    __m256i t2 = _mm256_unpackhi_epi32(x0, x1);
+    __m256i t3 = _mm256_unpackhi_epi32(x2, x3);
+    __m256i r0 = _mm256_unpacklo_epi64(t0, t1);
+    __m256i r1 = _mm256_unpackhi_epi64(t0, t1);
+    __m256i r2 = _mm256_unpacklo_epi64(t2, t3);
+    __m256i r3 = _mm256_unpackhi_epi64(t2, t3);
+    __m256i* out = reinterpret_cast<__m256i*>(bits + i);
+    _mm256_storeu_si256(out, _mm256_permute2x128_si256(r0, r1, 0x20));
+    _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(r2, r3, 0x20));
+    _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(r0, r1, 0x31));
+    _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(r2, r3, 0x31));
+  }
+  philoxColumnScalar(c0, c1 + i, c2, c3, k0, k1, count - i, bits + i);
+}
+
+__attribute__((target("avx512f")))
+inline void mulHiLoAvx512(__m512i a, __m512i m, __m512i& hi, __m512i& lo)
+{
+  __m512i even = _mm512_mul_epu32(a, m);
+  __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), m);
+  lo = _mm512_mask_blend_epi32(0xAAAA, even, _mm512_slli_epi64(odd, 32));
+  hi = _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(even, 32), odd);
+}
+
+// Sixteen counters at a time
+__attribute__((target("avx512f")))
+inline void philoxColumnAvx512(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t k0, uint32_t k1, int count, RandomBits* bits)
+{
+  const __m512i m0 = _mm512_set1_epi32(static_cast<int>(0xD2511F53u));
+  const __m512i m1 = _mm512_set1_epi32(static_cast<int>(0xCD9E8D57u));
+  const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+  int i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    __m512i x0 = _mm512_set1_epi32(static_cast<int>(c0));
+    __m512i x1 = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(c1 + i)), lanes);
+    __m512i x2 = _mm512_set1_epi32(static_cast<int>(c2));
+    __m512i x3 = _mm512_set1_epi32(static_cast<int>(c3));
+    uint32_t key0 = k0, key1 = k1;
+    for (int round = 0; round < 10; round++)
+    {
+      __m512i hi0, lo0, hi1, lo1;
+      mulHiLoAvx512(x0, m0, hi0, lo0);
+      mulHiLoAvx512(x2, m1, hi1, lo1);
+      x0 = _mm512_xor_si512(_mm512_xor_si512(hi1, x1), _mm512_set1_epi32(static_cast<int>(key0)));
+      x2 = _mm512_xor_si512(_mm512_xor_si512(hi0, x3), _mm512_set1_epi32(static_cast<int>(key1)));
+      x1 = lo1;
+      x3 = lo0;
+      key0 += 0x9E3779B9u;
+      key1 += 0xBB67AE85u;
+    }
+
+    // Transposed within the 128 bit quarters, which hold the counters j, j + 4, j + 8 and j + 12
+    __m512i t0 = _mm512_unpacklo_epi32(x0, x1);
+    __m512i t1 = _mm512_unpacklo_epi32(x2, x3);
+    __m512i t2 = _mm512_unpackhi_epi32(x0, x1);
+    __m512i t3 = _mm512_unpackhi_epi32(x2, x3);
+    const __m512i r[4] = {_mm512_unpacklo_epi64(t0, t1), _mm512_unpackhi_epi64(t0, t1),
+                          _mm512_unpacklo_epi64(t2, t3), _mm512_unpackhi_epi64(t2, t3)};
+    for (int j = 0; j < 4; j++)
+    {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(bits + i + j), _mm512_castsi512_si128(r[j]));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(bits + i + j + 4), _mm512_extracti32x4_epi32(r[j], 1));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(bits + i + j + 8), _mm512_extracti32x4_epi32(r[j], 2));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(bits + i + j + 12), _mm512_extracti32x4_epi32(r[j], 3));
+    }
+  }
+  philoxColumnScalar(c0, c1 + i, c2, c3, k0, k1, count - i, bits + i);
+}
+
+#endif
+
+/**
+ * Picks the fastest version for the given tier, the one of the CPU by default
+ **/
+inline PhiloxColumnFunction selectPhiloxColumn(CpuTier tier = cpuTier())
+{
+#ifdef LXF_X86
+  if (tier >= CPU_AVX512) return philoxColumnAvx512;
+  if (tier >= CPU_AVX2) return philoxColumnAvx2;
+#endif
+  return philoxColumnScalar;
+}
+
+/**
+ * A random number generator without state: the bits are a function of the seed
+ * and of where they are used (the frame, the pixel, and a stream telling apart
+ * the uses within a pixel). Unlike rand() it can be called from any number of
+ * threads, and the pixels get the same bits whatever order they are calculated in.
+ **/
+class CounterRandom
+{
+public:
+  explicit CounterRandom(uint64_t seed = 0)
+  {
+    reseed(seed);
+  }
+
+  void reseed(uint64_t seed)
+  {
+    k0 = static_cast<uint32_t>(seed);
+    k1 = static_cast<uint32_t>(seed >> 32);
+  }
+
+  // The seed given to reseed(), all there is to the state of the generator
+  uint64_t seed() const
+  {
+    return static_cast<uint64_t>(k1) << 32 | k0;
+  }
+
+  RandomBits operator()(uint32_t frame, uint32_t x, uint32_t y, uint32_t stream = 0) const
+  {
+    return philox4x32(x, y, frame, stream, k0, k1);
+  }
+
+  // The bits of the count pixels of column x from row y down, as operator() gives them one by one
+  void column(uint32_t frame, uint32_t x, uint32_t y, int count, uint32_t stream, RandomBits* bits) const
+  {
+    static const PhiloxColumnFunction generate = selectPhiloxColumn();
+    generate(x, y, frame, stream, k0, k1, count, bits);
+  }
+
+private:
+  uint32_t k0 = 0;
+  uint32_t k1 = 0;
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "frame_stats.h"
+
+/**
+ * Keeps the frames within the time budget of a target frame rate by changing the
+ * size of the screen the effect draws on, while the presenter scales it to the
+ * window. Some sharpness is lost instead of frames.
+ *
+ * The cost of a frame is the part which depends on the size of the screen: one
+ * update of the effect and the expansion and copy of the frame. It is smoothed
+ * over a few frames, and the size only changes when it is clearly out of the
+ * band around the budget:
+ *  - above 90% of the budget the screen shrinks at once, by about as much as the
+ *    cost has to go down (the cost is taken to be proportional to the pixels),
+ *  - below 60% of it, for two seconds in a row, it grows back in small steps.
+ * After every change the cost is left to settle for a while before the next one,
+ * resizing some of the effects costs a frame or two.
+ **/
+class ResolutionGovernor
+{
+public:
+  static constexpr double MIN_SCALE = 0.25;       // The screen does not go below a quarter of the window in either direction
+  static constexpr double SHRINK_ABOVE = 0.9;     // Fractions of the budget
+  static constexpr double GROW_BELOW = 0.6;
+  static constexpr double AIM = 0.75;             // Shrinking aims at this fraction of the budget
+  static constexpr double GROW_STEP = 1.1;
+  static const int SETTLE_FRAMES = 30;            // Frames ignored after a change
+  static const int GROW_FRAMES = 120;             // Frames below the band before growing
+
+  ResolutionGovernor(double targetFps, int outputWidth, int outputHeight)
+    : budgetNs(1e9 / targetFps), outputW(outputWidth), outputH(outputHeight)
+  {
+  }
+
+  // The window has changed its size, the screen keeps the same scale of it
+  void setOutputSize(int width, int height)
+  {
+    outputW = width;
+    outputH = height;
+    settle();
+  }
+
+  /**
+   * Takes the timings of the last frame. Returns true if the screen should have
+   * another size, given in width and height.
+   **/
+  bool frameDone(const FrameRecord& frame, int& width, int& height)
+  {
+    double cost = frame.phases[PHASE_UPDATE] / std::max(1, frame.steps) + frame.phases[PHASE_EXPAND] + frame.phases[PHASE_COPY];
+    if (ignored > 0)
+    {
+      ignored--;
+      return false;
+    }
+
+    smoothed = smoothed > 0 ? smoothed + (cost - smoothed) / 8 : cost;
+
+    double next = currentScale;
+    if (smoothed > SHRINK_ABOVE * budgetNs)
+    {
+      next = currentScale * std::sqrt(AIM * budgetNs / smoothed);
+    }
+    else if (smoothed < GROW_BELOW * budgetNs && currentScale < 1)
+    {
+      if (++cheapFrames >= GROW_FRAMES) next = currentScale * GROW_STEP;
+    }
+    else
+    {
+      cheapFrames = 0;
+    }
+
+    next = std::min(1.0, std::max(MIN_SCALE, next));
+    if (next == currentScale)
+    {
+      return false;
+    }
+
+    currentScale = next;
+    settle();
+    size(width, height);
+    return true;
+  }
+
+  // The size of the screen at the current scale, a multiple of 8 in both directions
+  void size(int& width, int& height) const
+  {
+    width = currentScale >= 1 ? outputW : std::max(16, static_cast<int>(outputW * currentScale) / 8 * 8);
+    height = currentScale >= 1 ? outputH : std::max(16, static_cast<int>(outputH * currentScale) / 8 * 8);
+  }
+
+  double scale() const { return currentScale; }
+
+private:
+  void settle()
+  {
+    ignored = SETTLE_FRAMES;
+    smoothed = 0;
+    cheapFrames = 0;
+  }
+
+  double budgetNs;
+  int outputW;
+  int outputH;
+  double currentScale = 1;
+  double smoothed = 0;          // The smoothed cost of the frames, in nanoseconds
+  int ignored = 0;              // Frames still to be ignored after a change
+  int cheapFrames = 0;          // Frames in a row well within the budget
+};
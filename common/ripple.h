@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstdint>
+
+#include "cpu_dispatch.h"
+
+/**
+ * The kernels of the water of part 4 (the ripples and the rain), a row of the
+ * height map at a time. newRow and oldRow point to the same row of the two
+ * pages of the height map, the rows above and below are width ints away, and
+ * the cells [1, width - 1) of the row are calculated.
+ *  - ripple: the new height is the average of the 8 neighbours in the old page,
+ *    minus the new height, less 1/density of the result,
+ *  - smooth: the new height is the mean of itself and of the average of the 8
+ *    neighbours in the old page.
+ * The divisions round towards zero, as in C++. The vectorized versions do them
+ * with shifts, so they are only used when density is a power of two.
+ **/
+typedef void (*RippleRowFunction)(int* newRow, const int* oldRow, int width, int density);
+
+inline int neighbourSum(const int* old, int width)
+{
+  return old[width] + old[-width] + old[1] + old[-1] +
+         old[-width - 1] + old[-width + 1] + old[width - 1] + old[width + 1];
+}
+
+inline void rippleCellsScalar(int* newRow, const int* oldRow, int width, int density, int first, int last)
+{
+  for (int x = first; x < last; x++)
+  {
+    int newHeight = neighbourSum(oldRow + x, width) / 8 - newRow[x];
+    newRow[x] = newHeight - newHeight / density;
+  }
+}
+
+inline void smoothCellsScalar(int* newRow, const int* oldRow, int width, int first, int last)
+{
+  for (int x = first; x < last; x++)
+  {
+    int newHeight = neighbourSum(oldRow + x, width) / 8 + newRow[x];
+    newRow[x] = newHeight >> 1;
+  }
+}
+
+inline void rippleRowScalar(int* newRow, const int* oldRow, int width, int density)
+{
+  rippleCellsScalar(newRow, oldRow, width, density, 1, width - 1);
+}
+
+inline void smoothRowScalar(int* newRow, const int* oldRow, int width, int)
+{
+  smoothCellsScalar(newRow, oldRow, width, 1, width - 1);
+}
+
+inline bool isPowerOfTwo(int density)
+{
+  return density > 0 && (density & (density - 1)) == 0;
+}
+
+#ifdef LXF_X86
+
+inline __m128i loadCellsSse2(const int* cells)
+{
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(cells));
+}
+
+inline __m128i neighbourSumSse2(const int* old, int width)
+{
+  __m128i above = _mm_add_epi32(_mm_add_epi32(loadCellsSse2(old - width - 1), loadCellsSse2(old - width)), loadCellsSse2(old - width + 1));
+  __m128i below = _mm_add_epi32(_mm_add_epi32(loadCellsSse2(old + width - 1), loadCellsSse2(old + width)), loadCellsSse2(old + width + 1));
+  return _mm_add_epi32(_mm_add_epi32(above, below), _mm_add_epi32(loadCellsSse2(old - 1), loadCellsSse2(old + 1)));
+}
+
+// Divides the lanes by 2^shift, rounding towards zero: the negative ones get 2^shift - 1 added first
+inline __m128i divideSse2(__m128i value, int shift)
+{
+  __m128i bias = _mm_srl_epi32(_mm_srai_epi32(value, 31), _mm_cvtsi32_si128(32 - shift));
+  return _mm_sra_epi32(_mm_add_epi32(value, bias), _mm_cvtsi32_si128(shift));
+}
+
+inline void rippleRowSse2(int* newRow, const int* oldRow, int width, int density)
+{
+  if (!isPowerOfTwo(density))
+  {
+    rippleRowScalar(newRow, oldRow, width, density);
+    return;
+  }
+  const int shift = __builtin_ctz(density);
+
+  int x = 1;
+  for (; x + 4 <= width - 1; x += 4)
+  {
+    __m128i* cells = reinterpret_cast<__m128i*>(newRow + x);
+    __m128i newHeight = _mm_sub_epi32(divideSse2(neighbourSumSse2(oldRow + x, width), 3), _mm_loadu_si128(cells));
+    _mm_storeu_si128(cells, _mm_sub_epi32(newHeight, divideSse2(newHeight, shift)));
+  }
+  rippleCellsScalar(newRow, oldRow, width, density, x, width - 1);
+}
+
+inline void smoothRowSse2(int* newRow, const int* oldRow, int width, int)
+{
+  int x = 1;
+  for (; x + 4 <= width - 1; x += 4)
+  {
+    __m128i* cells = reinterpret_cast<__m128i*>(newRow + x);
+    __m128i newHeight = _mm_add_epi32(divideSse2(neighbourSumSse2(oldRow + x, width), 3), _mm_loadu_si128(cells));
+    _mm_storeu_si128(cells, _mm_srai_epi32(newHeight, 1));
+  }
+  smoothCellsScalar(newRow, oldRow, width, x, width - 1);
+}
+
+__attribute__((target("avx2")))
+inline __m256i loadCellsAvx2(const int* cells)
+{
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cells));
+}
+
+__attribute__((target("avx2")))
+inline __m256i neighbourSumAvx2(const int* old, int width)
+{
+  __m256i above = _mm256_add_epi32(_mm256_add_epi32(loadCellsAvx2(old - width - 1), loadCellsAvx2(old - width)), loadCellsAvx2(old - width + 1));
+  __m256i below = _mm256_add_epi32(_mm256_add_epi32(loadCellsAvx2(old + width - 1), loadCellsAvx2(old + width)), loadCellsAvx2(old + width + 1));
+  return _mm256_add_epi32(_mm256_add_epi32(above, below), _mm256_add_epi32(loadCellsAvx2(old - 1), loadCellsAvx2(old + 1)));
+}
+
+__attribute__((target("avx2")))
+inline __m256i divideAvx2(__m256i value, int shift)
+{
+  __m256i bias = _mm256_srl_epi32(_mm256_srai_epi32(value, 31), _mm_cvtsi32_si128(32 - shift));
+  return _mm256_sra_epi32(_mm256_add_epi32(value, bias), _mm_cvtsi32_si128(shift));
+}
+
+__attribute__((target("avx2")))
+inline void rippleRowAvx2(int* newRow, const int* oldRow, int width, int density)
+{
+  if (!isPowerOfTwo(density))
+  {
+    rippleRowScalar(newRow, oldRow, width, density);
+    return;
+  }
+  const int shift = __builtin_ctz(density);
+
+  int x = 1;
+  for (; x + 8 <= width - 1; x += 8)
+  {
+    __m256i* cells = reinterpret_cast<__m256i*>(newRow + x);
+    __m256i newHeight = _mm256_sub_epi32(divideAvx2(neighbourSumAvx2(oldRow + x, width), 3), _mm256_loadu_si256(cells));
+    _mm256_storeu_si256(cells, _mm256_sub_epi32(newHeight, divideAvx2(newHeight, shift)));
+  }
+  rippleCellsScalar(newRow, oldRow, width, density, x, width - 1);
+}
+
+__attribute__((target("avx2")))
+inline void smoothRowAvx2(int* newRow, const int* oldRow, int width, int)
+{
+  int x = 1;
+  for (; x + 8 <= width - 1; x += 8)
+  {
+    __m256i* cells = reinterpret_cast<__m256i*>(newRow + x);
+    __m256i newHeight = _mm256_add_epi32(divideAvx2(neighbourSumAvx2(oldRow + x, width), 3), _mm256_loadu_si256(cells));
+    _mm256_storeu_si256(cells, _mm256_srai_epi32(newHeight, 1));
+  }
+  smoothCellsScalar(newRow, oldRow, width, x, width - 1);
+}
+
+#endif
+
+struct RippleKernels
+{
+  RippleRowFunction ripple;
+  RippleRowFunction smooth;
+};
+
+const RippleKernels RIPPLE_SCALAR = {rippleRowScalar, smoothRowScalar};
+#ifdef LXF_X86
+const RippleKernels RIPPLE_SSE2 = {rippleRowSse2, smoothRowSse2};
+const RippleKernels RIPPLE_AVX2 = {rippleRowAvx2, smoothRowAvx2};
+#endif
+
+/**
+ * Picks the fastest kernels for the given tier, the one of the CPU by default.
+ * There are no AVX-512 ones, that tier gets the AVX2 kernels.
+ **/
+inline RippleKernels selectRippleKernels(CpuTier tier = cpuTier())
+{
+#ifdef LXF_X86
+  if (tier >= CPU_AVX2) return RIPPLE_AVX2;
+  if (tier >= CPU_SSE2) return RIPPLE_SSE2;
+#endif
+  return RIPPLE_SCALAR;
+}
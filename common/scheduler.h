@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+
+/**
+ * Decides when the effect calculates its next frame. The simulation runs with a
+ * fixed timestep (1 / rate seconds), independently of how fast the machine is or
+ * how fast the display refreshes:
+ *  - if we are ahead, we sleep until the next step is due instead of spinning,
+ *  - if we are behind, several steps are run before the next presentation (the
+ *    frames in between are skipped), at most maxSteps of them, the rest of the
+ *    backlog is dropped so an overloaded machine slows down instead of spiralling.
+ * A rate of 0 runs one step per presentation, as fast as possible.
+ *
+ * When the presentation is paced by vsync, the present call already blocks until
+ * the next refresh, so a step which is due within half a step is run right away
+ * instead of sleeping past the refresh and missing it.
+ **/
+class FrameScheduler
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  FrameScheduler(double rate, int maxSteps = 5, bool vsync = false)
+    : step(rate > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate)) : Clock::duration::zero()),
+      maxSteps(maxSteps < 1 ? 1 : maxSteps),
+      slack(vsync ? step / 2 : Clock::duration::zero())
+  {
+  }
+
+  /**
+   * Returns the number of simulation steps to run before the next presentation,
+   * sleeping first if none is due yet. The very first call returns 1 immediately.
+   **/
+  int beginFrame()
+  {
+    if (step == Clock::duration::zero())
+    {
+      return 1;
+    }
+
+    Clock::time_point now = Clock::now();
+    if (!started)
+    {
+      started = true;
+      nextStep = now + step;
+      return 1;
+    }
+
+    if (now + slack < nextStep)
+    {
+      // We are ahead: give the core back until the step is due
+      std::this_thread::sleep_until(nextStep);
+      now = Clock::now();
+    }
+
+    int steps = 0;
+    while (nextStep <= now + slack && steps < maxSteps)
+    {
+      nextStep += step;
+      steps++;
+    }
+
+    if (nextStep <= now)
+    {
+      // Too far behind, forget about the steps we could not catch up with
+      droppedSteps += (now - nextStep) / step + 1;
+      nextStep = now + step;
+    }
+
+    skipped += steps - 1;
+    return steps;
+  }
+
+  // The number of calculated frames which were never presented
+  long skippedFrames() const { return skipped; }
+
+  // The number of simulation steps given up because the machine could not keep up
+  long droppedFrames() const { return droppedSteps; }
+
+private:
+  Clock::duration step;
+  int maxSteps;
+  Clock::duration slack;
+  bool started = false;
+  Clock::time_point nextStep;
+  long skipped = 0;
+  long droppedSteps = 0;
+};
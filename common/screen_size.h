@@ -0,0 +1,48 @@
+#pragma once
+
+/**
+ * The size of the screen as seen by a kernel. The hot kernels are templates on
+ * this type: for the common display sizes they are instantiated with the size
+ * as compile time constants (W and H), so the compiler knows the exact length
+ * of the rows and the strides, and any other size goes through the generic
+ * instantiation (W = H = 0), which reads the size at runtime.
+ **/
+template<int W, int H>
+struct ScreenSize
+{
+  int w;
+  int h;
+
+  constexpr int width() const { return W > 0 ? W : w; }
+  constexpr int height() const { return H > 0 ? H : h; }
+};
+
+/**
+ * Calls fn(size) with the ScreenSize instantiation matching the given size:
+ * 1280x720, 1920x1080, 2560x1440 and 3840x2160 have their own, everything
+ * else shares the generic one.
+ **/
+template<class Fn>
+inline void withScreenSize(int width, int height, Fn&& fn)
+{
+  if (width == 1280 && height == 720)
+  {
+    fn(ScreenSize<1280, 720>{width, height});
+  }
+  else if (width == 1920 && height == 1080)
+  {
+    fn(ScreenSize<1920, 1080>{width, height});
+  }
+  else if (width == 2560 && height == 1440)
+  {
+    fn(ScreenSize<2560, 1440>{width, height});
+  }
+  else if (width == 3840 && height == 2160)
+  {
+    fn(ScreenSize<3840, 2160>{width, height});
+  }
+  else
+  {
+    fn(ScreenSize<0, 0>{width, height});
+  }
+}
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "compositor.h"
+#include "effect.h"
+#include "framebuffer.h"
+#include "host.h"
+#include "palette_expand.h"
+#include "presenter.h"
+#include "upscale.h"
+
+/**
+ * Shows the frames in an SDL window. One streaming ARGB8888 texture of the size
+ * of the frames is kept, and every frame is expanded through the palette straight
+ * into the locked memory of that texture, so nothing gets allocated per frame.
+ * The texture is only created again when the size of the frames changes.
+ *
+ * When the screen tracks its changed rows and the palette is the one of the last
+ * frame, only those rows are expanded and uploaded, with SDL_UpdateTexture().
+ * If more than half of the rows have changed, the whole texture is updated.
+ *
+ * With an upscale filter, frames much smaller than the window (the effects with
+ * a fixed size, or drawn at a lower resolution with --pixel-size or by the
+ * resolution governor) are enlarged by the largest integer factor fitting the
+ * window on the CPU, on their way into the texture, and SDL only scales the rest.
+ *
+ * The frames of the effects with layers (see LayeredEffect) are composited
+ * into the texture with a Compositor.
+ *
+ * The window can be resized; the new size, in pixels of the display, is passed
+ * on to the host, so the effects can draw at the native resolution.
+ **/
+class SdlPresenter : public Presenter
+{
+public:
+  explicit SdlPresenter(bool vsync = false, bool fullscreen = false, UpscaleFilter filter = UPSCALE_NONE)
+    : filter(filter), vsync(vsync), fullscreen(fullscreen)
+  {
+  }
+
+  ~SdlPresenter() override
+  {
+    close();
+  }
+
+  bool open(const char* title, int width, int height) override
+  {
+    // Initialize SDL, for now we use only the Video subsystem
+    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    {
+      std::cerr << "Cannot initialize SDL:" << SDL_GetError() << std::endl;
+      return false;
+    }
+    initialized = true;
+
+    Uint32 flags = SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_RESIZABLE | (fullscreen ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0);
+    window = SDL_CreateWindow(title, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                              width, height, flags);
+    if (!window)
+    {
+      std::cerr << "Cannot create window:" << SDL_GetError() << std::endl;
+      close();
+      return false;
+    }
+
+    // With vsync the presentation blocks until the next refresh of the display
+    renderer = SDL_CreateRenderer(window, -1, vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
+    if (!renderer)
+    {
+      std::cerr << "Cannot create renderer:" << SDL_GetError() << std::endl;
+      close();
+      return false;
+    }
+
+    // On high DPI displays and in fullscreen the window has more pixels than asked for
+    outputWidth = width;
+    outputHeight = height;
+    outputSizeChanged();
+    return true;
+  }
+
+  bool quitRequested() override
+  {
+    SDL_Event e;
+    while (SDL_PollEvent(&e) > 0)
+    {
+      if (e.type == SDL_QUIT)
+      {
+        exitRequest = true;
+      }
+      else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+      {
+        outputSizeChanged();
+      }
+    }
+    return exitRequest;
+  }
+
+  bool resizeRequested(int& width, int& height) override
+  {
+    if (!resizePending)
+    {
+      return false;
+    }
+    resizePending = false;
+    width = outputWidth;
+    height = outputHeight;
+    return true;
+  }
+
+  void present(const Framebuffer& screen, const Palette& palette) override
+  {
+    {
+      ScopedTimer timer(stats, PHASE_EXPAND);
+      int factor = filter == UPSCALE_NONE ? 1 : upscaleFactor(screen.width(), screen.height(), outputWidth, outputHeight);
+      bool fresh = !texture || screen.width() * factor != textureWidth || screen.height() * factor != textureHeight;
+      if (!createTexture(screen.width() * factor, screen.height() * factor))
+      {
+        return;
+      }
+
+      if (factor > 1)
+      {
+        upscaleTexture(screen, palette, factor);
+      }
+      else if (!fresh && !composited && memcmp(palette.data(), uploadedPalette.data(), sizeof(Palette)) == 0 && screen.dirtyRowCount() <= screen.height() / 2)
+      {
+        updateDirtyRows(screen);
+      }
+      else
+      {
+        updateTexture(screen, palette);
+      }
+      composited = false;
+    }
+
+    show();
+  }
+
+  /**
+   * The layers are composited straight into the locked texture, at the size of
+   * the screen: SDL does all the scaling of these frames
+   **/
+  void presentLayers(const Framebuffer& screen, const Palette& palette, const std::vector<Layer>& layers) override
+  {
+    {
+      ScopedTimer timer(stats, PHASE_EXPAND);
+      if (!createTexture(screen.width(), screen.height()))
+      {
+        return;
+      }
+
+      void* pixels = nullptr;
+      int pitch = 0;
+      if (SDL_LockTexture(texture, NULL, &pixels, &pitch) < 0)
+      {
+        std::cerr << "Cannot lock texture:" << SDL_GetError() << std::endl;
+        return;
+      }
+      compositor.composite(screen, palette, layers, static_cast<uint8_t*>(pixels), pitch);
+      SDL_UnlockTexture(texture);
+      composited = true;
+    }
+
+    show();
+  }
+
+  void close() override
+  {
+    if (texture) SDL_DestroyTexture(texture);
+    if (renderer) SDL_DestroyRenderer(renderer);
+    if (window) SDL_DestroyWindow(window);
+    if (initialized) SDL_Quit();
+    initialized = false;
+    texture = nullptr;
+    renderer = nullptr;
+    window = nullptr;
+  }
+
+private:
+  // Copies the texture to the window and shows it
+  void show()
+  {
+    {
+      ScopedTimer timer(stats, PHASE_COPY);
+      SDL_RenderCopy(renderer, texture, NULL, NULL);
+    }
+
+    {
+      ScopedTimer timer(stats, PHASE_PRESENT);
+      SDL_RenderPresent(renderer);
+    }
+  }
+
+  // Expands the whole screen straight into the locked texture
+  void updateTexture(const Framebuffer& screen, const Palette& palette)
+  {
+    buildPaletteLut(palette, lut);
+
+    void* pixels = nullptr;
+    int pitch = 0;
+    if (SDL_LockTexture(texture, NULL, &pixels, &pitch) < 0)
+    {
+      std::cerr << "Cannot lock texture:" << SDL_GetError() << std::endl;
+      return;
+    }
+
+    // The rows of the texture might be padded, so we expand row by row
+    uint8_t* target = static_cast<uint8_t*>(pixels);
+    const bool stream = streamFrame(static_cast<size_t>(pitch) * screen.height());
+    for (int y = 0; y < screen.height(); y++)
+    {
+      expandPalette(screen.row(y), reinterpret_cast<uint32_t*>(target + y * pitch), screen.width(), lut, stream);
+    }
+    SDL_UnlockTexture(texture);
+    uploadedPalette = palette;
+  }
+
+  // Expands and enlarges the whole screen straight into the locked texture
+  void upscaleTexture(const Framebuffer& screen, const Palette& palette, int factor)
+  {
+    buildPaletteLut(palette, lut);
+
+    void* pixels = nullptr;
+    int pitch = 0;
+    if (SDL_LockTexture(texture, NULL, &pixels, &pitch) < 0)
+    {
+      std::cerr << "Cannot lock texture:" << SDL_GetError() << std::endl;
+      return;
+    }
+    upscaler.upscale(screen, lut, filter, factor, static_cast<uint8_t*>(pixels), pitch);
+    SDL_UnlockTexture(texture);
+    uploadedPalette = palette;
+  }
+
+  // Expands the changed rows, and uploads every run of them as one rectangle
+  void updateDirtyRows(const Framebuffer& screen)
+  {
+    const int width = screen.width();
+    for (int y = 0; y < screen.height(); )
+    {
+      if (!screen.rowDirty(y))
+      {
+        y++;
+        continue;
+      }
+
+      int first = y;
+      while (y < screen.height() && screen.rowDirty(y)) y++;
+
+      staging.resize(static_cast<size_t>(width) * (y - first));
+      const bool stream = streamFrame(staging.size() * sizeof(uint32_t));
+      for (int row = first; row < y; row++)
+      {
+        expandPalette(screen.row(row), staging.data() + static_cast<size_t>(row - first) * width, width, lut, stream);
+      }
+      SDL_Rect rect = {0, first, width, y - first};
+      SDL_UpdateTexture(texture, &rect, staging.data(), width * static_cast<int>(sizeof(uint32_t)));
+    }
+  }
+
+  /**
+   * Makes sure the texture has the given size. It is created again only when
+   * the size of the frames changes.
+   **/
+  bool createTexture(int width, int height)
+  {
+    if (texture && width == textureWidth && height == textureHeight)
+    {
+      return true;
+    }
+
+    if (texture) SDL_DestroyTexture(texture);
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (!texture)
+    {
+      std::cerr << "Cannot create texture:" << SDL_GetError() << std::endl;
+      return false;
+    }
+    textureWidth = width;
+    textureHeight = height;
+    return true;
+  }
+
+  // Asks for a new screen when the size of the window, in pixels, is not the last one seen
+  void outputSizeChanged()
+  {
+    int w = 0, h = 0;
+    if (SDL_GetRendererOutputSize(renderer, &w, &h) == 0 && (w != outputWidth || h != outputHeight))
+    {
+      outputWidth = w;
+      outputHeight = h;
+      resizePending = true;
+    }
+  }
+
+  SDL_Window* window = nullptr;
+  SDL_Renderer* renderer = nullptr;
+  SDL_Texture* texture = nullptr;
+  int textureWidth = 0;
+  int textureHeight = 0;
+  int outputWidth = 0;
+  int outputHeight = 0;
+  PaletteLut lut;
+  Palette uploadedPalette;                    // The palette the texture was last expanded with
+  std::vector<uint32_t> staging;              // The changed rows, expanded
+  UpscaleFilter filter = UPSCALE_NONE;
+  Upscaler upscaler;
+  Compositor compositor;
+  bool composited = false;                    // The texture holds a frame with layers, not the expanded screen
+  bool vsync = false;
+  bool fullscreen = false;
+  bool initialized = false;
+  bool exitRequest = false;
+  bool resizePending = false;
+};
+
+/**
+ * The main() of the effects: reads the command line and runs the effect either
+ * in an SDL window or, with --headless, without any display at all.
+ **/
+inline int runEffectMain(Effect& effect, int argc, char* argv[])
+{
+  HostOptions options;
+  if (!parseHostOptions(argc, argv, options))
+  {
+    return EXIT_FAILURE;
+  }
+
+  if (options.headless)
+  {
+    NullPresenter presenter;
+    return runEffect(effect, presenter, options);
+  }
+
+  SdlPresenter presenter(options.vsync, options.fullscreen, options.upscale);
+  return runEffect(effect, presenter, options);
+}
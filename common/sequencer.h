@@ -0,0 +1,266 @@
+#pragma once
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "all_effects.h"
+#include "effect.h"
+#include "framebuffer.h"
+
+/**
+ * One entry of the timeline of a demo: the effect to show and for how long
+ **/
+struct SequenceEntry
+{
+  std::string effect;         // The short name of the effect, as given to makeEffect()
+  double seconds = 0;
+};
+
+/**
+ * Reads a timeline: one "effect seconds" pair per line, in the order they are
+ * shown. Empty lines and the ones starting with # are skipped.
+ **/
+inline bool loadSequence(const std::string& filename, std::vector<SequenceEntry>& entries)
+{
+  std::ifstream in(filename);
+  if (!in)
+  {
+    std::cerr << "Cannot open sequence:" << filename << std::endl;
+    return false;
+  }
+
+  std::string line;
+  for (int number = 1; std::getline(in, line); number++)
+  {
+    std::istringstream fields(line);
+    SequenceEntry entry;
+    if (!(fields >> entry.effect) || entry.effect[0] == '#') continue;
+    if (!(fields >> entry.seconds) || entry.seconds <= 0)
+    {
+      std::cerr << "Invalid sequence entry at " << filename << ":" << number << std::endl;
+      return false;
+    }
+    entries.push_back(entry);
+  }
+
+  if (entries.empty())
+  {
+    std::cerr << "Empty sequence:" << filename << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * A demo: several effects of the series shown one after the other in the same
+ * window, following a timeline. To the host it is just another effect.
+ *
+ * While an effect runs, the next one is created and initialized on a thread of
+ * its own (loading its textures, calculating its tables and its first screen),
+ * so switching to it costs no more than a frame. If it is not ready when its
+ * time comes, the current effect goes on until it is. The effect left behind is
+ * destroyed on that thread as well.
+ *
+ * The timeline runs at SEQUENCE_RATE frames per second, and the effects are
+ * updated at their own rates within it. The effects which can only be drawn at
+ * their own size are drawn on a screen of that size, scaled to the one of the demo.
+ **/
+class SequenceEffect : public Effect
+{
+public:
+  static constexpr double SEQUENCE_RATE = 100;
+
+  SequenceEffect(std::vector<SequenceEntry> timeline, std::string root = "..")
+    : root(std::move(root))
+  {
+    // The same effect twice in a row is shown once, for the two durations
+    for (const SequenceEntry& entry : timeline)
+    {
+      if (!entries.empty() && entries.back().effect == entry.effect)
+      {
+        entries.back().seconds += entry.seconds;
+      }
+      else
+      {
+        entries.push_back(entry);
+      }
+    }
+  }
+
+  const char* title() const override { return "Demologia"; }
+  int width() const override { return 1280; }
+  int height() const override { return 720; }
+  double updateRate() const override { return SEQUENCE_RATE; }
+
+  bool resize(Framebuffer& screen) override
+  {
+    screenWidth = screen.width();
+    screenHeight = screen.height();
+    if (current && !current->scaled)
+    {
+      current->effect->resize(screen);
+    }
+    return true;
+  }
+
+  bool init(Framebuffer& screen) override
+  {
+    // The first effect is prepared right away, nothing is running yet
+    for (index = 0; index < static_cast<int>(entries.size()); index++)
+    {
+      std::unique_ptr<Stage> stage = prepare(entries[index], root, screenWidth, screenHeight, nullptr);
+      if (stage)
+      {
+        start(std::move(stage), screen);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool update(Framebuffer& screen) override
+  {
+    if (elapsed >= current->frames || current->finished)
+    {
+      // The time of the effect is up, the next one takes over if it is ready
+      if (!next.valid())
+      {
+        return false;
+      }
+      if (next.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+      {
+        std::unique_ptr<Stage> stage = next.get();
+        if (stage)
+        {
+          start(std::move(stage), screen);
+        }
+        else
+        {
+          // It could not be initialized, the one after it is prepared instead
+          preload(nullptr);
+        }
+      }
+    }
+
+    if (!current->finished)
+    {
+      Framebuffer& target = current->scaled ? current->screen : screen;
+      current->pending += current->effect->updateRate() / SEQUENCE_RATE;
+      for (; current->pending >= 1 && !current->finished; current->pending -= 1)
+      {
+        current->finished = !current->effect->update(target);
+      }
+    }
+
+    if (current->scaled)
+    {
+      scaleNearest(current->screen, screen);
+    }
+    colours = current->effect->palette();
+    overlays = current->effect->layers();
+    elapsed++;
+    return true;
+  }
+
+private:
+  /**
+   * An effect of the timeline with the screen it was initialized on. The ones
+   * which cannot be resized keep drawing on that screen.
+   **/
+  struct Stage
+  {
+    std::unique_ptr<Effect> effect;
+    Framebuffer screen;
+    bool scaled = false;          // The effect draws at its own size, the frames are scaled
+    long frames = 0;              // How many frames of the timeline the effect is shown for
+    double pending = 0;           // The updates of the effect due, at its own rate
+    bool finished = false;        // The effect has nothing more to show
+  };
+
+  /**
+   * Creates and initializes the effect of the entry for a screen of the given size.
+   * Runs on the loader thread, which also destroys the effect shown before.
+   **/
+  static std::unique_ptr<Stage> prepare(SequenceEntry entry, std::string root, int width, int height, std::unique_ptr<Stage> retired)
+  {
+    retired.reset();
+
+    auto stage = std::make_unique<Stage>();
+    stage->effect = makeEffect(entry.effect, root);
+    if (!stage->effect)
+    {
+      std::cerr << "Unknown effect: " << entry.effect << std::endl;
+      return nullptr;
+    }
+
+    stage->screen.resize(width, height);
+    if (!stage->effect->resize(stage->screen))
+    {
+      stage->scaled = true;
+      stage->screen.resize(stage->effect->width(), stage->effect->height());
+      stage->effect->resize(stage->screen);
+    }
+    if (!stage->effect->init(stage->screen))
+    {
+      return nullptr;
+    }
+    stage->frames = static_cast<long>(entry.seconds * SEQUENCE_RATE + 0.5);
+    return stage;
+  }
+
+  // Starts preparing the entry after the current one, if there is one
+  void preload(std::unique_ptr<Stage> retired)
+  {
+    if (++index >= static_cast<int>(entries.size())) return;
+    next = std::async(std::launch::async, prepare, entries[index], root, screenWidth, screenHeight, std::move(retired));
+  }
+
+  // Makes the prepared stage the one shown, and starts preparing the next one
+  void start(std::unique_ptr<Stage> stage, Framebuffer& screen)
+  {
+    if (!stage->scaled)
+    {
+      if (stage->screen.width() == screen.width() && stage->screen.height() == screen.height())
+      {
+        screen.copyFrom(stage->screen);
+      }
+      else
+      {
+        // The demo was resized while the effect was being prepared
+        screen.clear();
+        stage->effect->resize(screen);
+      }
+      screen.trackDamage(stage->screen.tracksDamage());
+      stage->screen = Framebuffer();
+    }
+    else
+    {
+      // The scaled frames cover the whole screen
+      screen.trackDamage(false);
+    }
+    screen.markDirty(0, screen.height());
+
+    std::unique_ptr<Stage> retired = std::move(current);
+    current = std::move(stage);
+    elapsed = 0;
+    preload(std::move(retired));
+  }
+
+  std::vector<SequenceEntry> entries;
+  std::string root;                             // The top directory of the repository, for the assets
+  int screenWidth = 0;                          // The size of the screen of the demo
+  int screenHeight = 0;
+
+  int index = 0;                                // The entry being prepared (or shown, if none is)
+  std::unique_ptr<Stage> current;               // The effect being shown
+  long elapsed = 0;                             // For how many frames it has been shown
+  std::future<std::unique_ptr<Stage>> next;     // The effect being prepared
+};
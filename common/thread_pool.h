@@ -0,0 +1,313 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+/**
+ * A pool of worker threads with one task queue per thread. A thread takes its
+ * work from the back of its own queue and, once that is empty, steals from the
+ * front of the others, so bands which take longer (the inside of the Mandelbrot
+ * set, for example) do not leave the rest of the threads idle.
+ *
+ * The thread calling parallelFor() (the main loop, or the simulation thread when
+ * pipelined) takes part in the work until all of it is done. Every range carries
+ * its own work and counter, so another thread (the loader of the demo) can call
+ * it at the same time; the callers then also help with each other's ranges.
+ *
+ * Dispatching the ranges allocates nothing: they refer to the callable of the
+ * caller without copying it, and the queues are rings of a fixed size allocated
+ * with the pool. A range which finds its queue full is done by the caller.
+ **/
+class ThreadPool
+{
+public:
+  static const int QUEUE_CAPACITY = 256;     // The ranges waiting in the queue of a thread, at most
+
+  // threads is the total number of threads working, including the caller of parallelFor()
+  explicit ThreadPool(int threads)
+  {
+    threads = std::max(1, threads);
+    for (int i = 0; i < threads; i++)
+    {
+      queues.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 1; i < threads; i++)
+    {
+      workers.emplace_back([this, i] { workerLoop(i); });
+    }
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      stop = true;
+    }
+    wake.notify_all();
+    for (auto& w : workers)
+    {
+      w.join();
+    }
+  }
+
+  int threadCount() const { return static_cast<int>(queues.size()); }
+
+  /**
+   * Calls fn(first, last) for consecutive ranges covering [begin, end), each of
+   * them grain long (the last one may be shorter), spread over the threads.
+   * Returns when all of them have finished.
+   **/
+  template<class Fn>
+  void parallelFor(int begin, int end, int grain, const Fn& fn)
+  {
+    if (end <= begin) return;
+    grain = std::max(1, grain);
+
+    int count = (end - begin + grain - 1) / grain;
+    if (count == 1 || queues.size() == 1)
+    {
+      fn(begin, end);
+      return;
+    }
+
+    std::atomic<int> remaining(count);
+    const RangeFunction function(fn);
+    int queued = 0;
+    for (int i = 0; i < count; i++)
+    {
+      Task task{&function, begin + i * grain, std::min(end, begin + (i + 1) * grain), &remaining};
+      Queue& queue = *queues[i % queues.size()];
+      std::unique_lock<std::mutex> lock(queue.mutex);
+      if (queue.push(task))
+      {
+        queued++;
+        continue;
+      }
+      lock.unlock();
+      run(task);
+    }
+
+    if (queued > 0)
+    {
+      {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        pending += queued;
+      }
+      wake.notify_all();
+    }
+
+    // The caller works as well, until every range has been done by somebody
+    Task task;
+    while (remaining.load(std::memory_order_acquire) > 0)
+    {
+      if (take(0, task))
+      {
+        run(task);
+      }
+      else
+      {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+private:
+  /**
+   * The callable of a parallelFor(), called through a pointer to it and to a
+   * function knowing its type, without owning or copying it
+   **/
+  class RangeFunction
+  {
+  public:
+    template<class Fn>
+    explicit RangeFunction(const Fn& fn)
+      : callable(&fn), call([](const void* callable, int first, int last) { (*static_cast<const Fn*>(callable))(first, last); })
+    {
+    }
+
+    void operator()(int first, int last) const { call(callable, first, last); }
+
+  private:
+    const void* callable;
+    void (*call)(const void* callable, int first, int last);
+  };
+
+  struct Task
+  {
+    const RangeFunction* fn = nullptr;
+    int begin = 0;
+    int end = 0;
+    std::atomic<int>* remaining = nullptr;
+  };
+
+  // The ranges waiting for a thread, in a ring taken from at both ends
+  struct Queue
+  {
+    std::mutex mutex;
+    Task tasks[QUEUE_CAPACITY];
+    int first = 0;
+    int count = 0;
+
+    bool empty() const { return count == 0; }
+
+    bool push(const Task& task)
+    {
+      if (count == QUEUE_CAPACITY) return false;
+      tasks[(first + count) % QUEUE_CAPACITY] = task;
+      count++;
+      return true;
+    }
+
+    Task popBack()
+    {
+      count--;
+      return tasks[(first + count) % QUEUE_CAPACITY];
+    }
+
+    Task popFront()
+    {
+      Task task = tasks[first];
+      first = (first + 1) % QUEUE_CAPACITY;
+      count--;
+      return task;
+    }
+  };
+
+  // Takes a task from the back of our own queue, or steals one from the front of another one
+  bool take(int self, Task& task)
+  {
+    for (size_t n = 0; n < queues.size(); n++)
+    {
+      size_t index = (self + n) % queues.size();
+      Queue& queue = *queues[index];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.empty()) continue;
+
+      task = n == 0 ? queue.popBack() : queue.popFront();
+      pending--;
+      return true;
+    }
+    return false;
+  }
+
+  void run(Task& task)
+  {
+    (*task.fn)(task.begin, task.end);
+    task.remaining->fetch_sub(1, std::memory_order_release);
+  }
+
+  void workerLoop(int self)
+  {
+    Task task;
+    while (true)
+    {
+      if (take(self, task))
+      {
+        run(task);
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      wake.wait(lock, [this] { return stop || pending.load() > 0; });
+      if (stop) return;
+    }
+  }
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  std::atomic<int> pending{0};
+  bool stop = false;
+};
+
+/**
+ * The number of threads of the default pool: set by setThreadCount(), or by the
+ * LXF_THREADS environment variable, or the number of cores otherwise
+ **/
+inline int& configuredThreadCount()
+{
+  static int count = 0;
+  return count;
+}
+
+/**
+ * Sets the number of threads the effects use. Has to be called before the first
+ * parallelForRows(), the pool is not resized afterwards.
+ **/
+inline void setThreadCount(int threads)
+{
+  configuredThreadCount() = threads;
+}
+
+inline ThreadPool& defaultThreadPool()
+{
+  static ThreadPool pool([] {
+    int threads = configuredThreadCount();
+    const char* env = getenv("LXF_THREADS");
+    if (threads <= 0 && env) threads = atoi(env);
+    if (threads <= 0) threads = static_cast<int>(std::thread::hardware_concurrency());
+    return std::max(1, threads);
+  }());
+  return pool;
+}
+
+/**
+ * Returns the number of rows of a band, such that every band starts on a cache
+ * line boundary (given that the first row does) and no two threads write to the
+ * same cache line. There are a few bands per thread, for the load balancing.
+ **/
+inline int bandRows(int height, int stride, int threads)
+{
+  const int cacheLine = 64;
+  int unit = cacheLine / std::gcd(std::max(1, stride), cacheLine);
+  int bands = std::max(1, threads * 4);
+  int rows = (height + bands - 1) / bands;
+  rows = (rows + unit - 1) / unit * unit;
+  return std::max(rows, unit);
+}
+
+/**
+ * Calls fn(firstRow, lastRow) for bands of rows covering [0, height) of a screen
+ * with the given stride (bytes per row), on the default pool. The bands can run
+ * in any order and in parallel, so fn must not depend on other rows being done.
+ **/
+template<class Fn>
+inline void parallelForRows(int height, int stride, const Fn& fn)
+{
+  ThreadPool& pool = defaultThreadPool();
+  pool.parallelFor(0, height, bandRows(height, stride, pool.threadCount()), fn);
+}
+
+/**
+ * Calls fn(first, last) for bands of bandWidth columns covering [begin, end), for
+ * the kernels working in place, which read and write the columns next to the one
+ * they calculate. Neighbouring bands never run at the same time: the even bands
+ * are done first, in parallel, then the odd ones. The columns next to the edges of
+ * the screen are in its guard bands, so the first and the last band never touch.
+ * As the bands do not depend on the number of threads, neither does the result.
+ **/
+template<class Fn>
+inline void parallelForColumnBands(int begin, int end, int bandWidth, const Fn& fn)
+{
+  int bands = (end - begin + bandWidth - 1) / bandWidth;
+
+  ThreadPool& pool = defaultThreadPool();
+  for (int parity = 0; parity < 2; parity++)
+  {
+    pool.parallelFor(0, (bands - parity + 1) / 2, 1, [&](int first, int last) {
+      for (int i = first; i < last; i++)
+      {
+        int x = begin + (2 * i + parity) * bandWidth;
+        fn(x, std::min(end, x + bandWidth));
+      }
+    });
+  }
+}
@@ -0,0 +1,394 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "cpu_dispatch.h"
+#include "framebuffer.h"
+#include "palette_expand.h"
+
+/**
+ * How the frames are enlarged on the CPU before they are handed to SDL
+ **/
+enum UpscaleFilter
+{
+  UPSCALE_NONE,       // SDL scales the frames to the window
+  UPSCALE_NEAREST,    // Every pixel becomes a block of factor x factor pixels
+  UPSCALE_BILINEAR    // The pixels in between are interpolated, in fixed point
+};
+
+const int MAX_UPSCALE = 4;
+
+// Reads the name of a filter, "nearest" or "bilinear". Returns false if it is neither.
+inline bool parseUpscaleFilter(const std::string& name, UpscaleFilter& filter)
+{
+  if (name == "nearest") filter = UPSCALE_NEAREST;
+  else if (name == "bilinear") filter = UPSCALE_BILINEAR;
+  else return false;
+  return true;
+}
+
+/**
+ * The integer factor a frame of the given size is enlarged by for an output of the
+ * other size: the largest one still fitting into the output, at most MAX_UPSCALE.
+ * SDL scales the rest of the way.
+ **/
+inline int upscaleFactor(int width, int height, int outputWidth, int outputHeight)
+{
+  if (width <= 0 || height <= 0) return 1;
+  return std::max(1, std::min({MAX_UPSCALE, outputWidth / width, outputHeight / height}));
+}
+
+/**
+ * Mixes two ARGB8888 pixels, weight / 256 of b to the rest of a. Two channels are
+ * done with every multiply, each in a 16 bit lane of its own which cannot overflow
+ * into the next one: 255 * 256 still fits.
+ **/
+inline uint32_t blendPixel(uint32_t a, uint32_t b, uint32_t weight)
+{
+  uint32_t rb = ((a & 0xFF00FFu) * (256 - weight) + (b & 0xFF00FFu) * weight) >> 8;
+  uint32_t ag = ((a >> 8) & 0xFF00FFu) * (256 - weight) + ((b >> 8) & 0xFF00FFu) * weight;
+  return (rb & 0xFF00FFu) | (ag & 0xFF00FF00u);
+}
+
+/**
+ * Repeats every one of count pixels factor (1..MAX_UPSCALE) times
+ **/
+inline void widenRowScalar(const uint32_t* src, uint32_t* dst, int count, int factor)
+{
+  for (int i = 0; i < count; i++)
+  {
+    for (int k = 0; k < factor; k++)
+    {
+      *dst++ = src[i];
+    }
+  }
+}
+
+/**
+ * Blends count pixels of the rows a and b, weight (0..256) / 256 of b
+ **/
+inline void blendRowsScalar(const uint32_t* a, const uint32_t* b, uint32_t* dst, int count, int weight)
+{
+  for (int i = 0; i < count; i++)
+  {
+    dst[i] = blendPixel(a[i], b[i], weight);
+  }
+}
+
+/**
+ * Interpolates count pixels of a row: pixel i blends the pixels columns[i] and
+ * columns[i] + 1 of src, with the weight in the low 16 bits of weights[i]
+ **/
+inline void interpolateRowScalar(const uint32_t* src, const int* columns, const uint32_t* weights, uint32_t* dst, int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    dst[i] = blendPixel(src[columns[i]], src[columns[i] + 1], weights[i] & 0xFFFF);
+  }
+}
+
+#ifdef LXF_X86
+
+/**
+ * The same lanes as blendPixel(), for four pixels; weight holds the weight of
+ * every pixel twice, in both its 16 bit halves
+ **/
+inline __m128i blendPixelsSse2(__m128i a, __m128i b, __m128i weight)
+{
+  const __m128i mask = _mm_set1_epi32(0x00FF00FF);
+  const __m128i rest = _mm_sub_epi16(_mm_set1_epi16(256), weight);
+  __m128i rb = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(a, mask), rest), _mm_mullo_epi16(_mm_and_si128(b, mask), weight));
+  __m128i ag = _mm_add_epi16(_mm_mullo_epi16(_mm_srli_epi16(a, 8), rest), _mm_mullo_epi16(_mm_srli_epi16(b, 8), weight));
+  return _mm_or_si128(_mm_srli_epi16(rb, 8), _mm_andnot_si128(mask, ag));
+}
+
+/**
+ * Four pixels are loaded at a time and spread over factor stores by unpacks and
+ * shuffles of their 32 bit lanes
+ **/
+inline void widenRowSse2(const uint32_t* src, uint32_t* dst, int count, int factor)
+{
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i* out = reinterpret_cast<__m128i*>(dst + i * factor);
+    switch (factor)
+    {
+    case 2:
+      _mm_storeu_si128(out, _mm_unpacklo_epi32(p, p));
+      _mm_storeu_si128(out + 1, _mm_unpackhi_epi32(p, p));
+      break;
+    case 3:
+      _mm_storeu_si128(out, _mm_shuffle_epi32(p, _MM_SHUFFLE(1, 0, 0, 0)));
+      _mm_storeu_si128(out + 1, _mm_shuffle_epi32(p, _MM_SHUFFLE(2, 2, 1, 1)));
+      _mm_storeu_si128(out + 2, _mm_shuffle_epi32(p, _MM_SHUFFLE(3, 3, 3, 2)));
+      break;
+    case 4:
+      _mm_storeu_si128(out, _mm_shuffle_epi32(p, _MM_SHUFFLE(0, 0, 0, 0)));
+      _mm_storeu_si128(out + 1, _mm_shuffle_epi32(p, _MM_SHUFFLE(1, 1, 1, 1)));
+      _mm_storeu_si128(out + 2, _mm_shuffle_epi32(p, _MM_SHUFFLE(2, 2, 2, 2)));
+      _mm_storeu_si128(out + 3, _mm_shuffle_epi32(p, _MM_SHUFFLE(3, 3, 3, 3)));
+      break;
+    default:
+      _mm_storeu_si128(out, p);
+      break;
+    }
+  }
+  widenRowScalar(src + i, dst + i * factor, count - i, factor);
+}
+
+inline void blendRowsSse2(const uint32_t* a, const uint32_t* b, uint32_t* dst, int count, int weight)
+{
+  const __m128i w = _mm_set1_epi16(static_cast<short>(weight));
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128i pa = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i pb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), blendPixelsSse2(pa, pb, w));
+  }
+  blendRowsScalar(a + i, b + i, dst + i, count - i, weight);
+}
+
+// SSE2 has no gather, the pixels are fetched one by one
+inline void interpolateRowSse2(const uint32_t* src, const int* columns, const uint32_t* weights, uint32_t* dst, int count)
+{
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    const int* c = columns + i;
+    __m128i pa = _mm_setr_epi32(src[c[0]], src[c[1]], src[c[2]], src[c[3]]);
+    __m128i pb = _mm_setr_epi32(src[c[0] + 1], src[c[1] + 1], src[c[2] + 1], src[c[3] + 1]);
+    __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), blendPixelsSse2(pa, pb, w));
+  }
+  interpolateRowScalar(src, columns + i, weights + i, dst + i, count - i);
+}
+
+/**
+ * Eight pixels are loaded at a time; every output vector is a permutation of
+ * them, the lane j of the k-th one taking the pixel (8k + j) / factor.
+ **/
+__attribute__((target("avx2")))
+inline void widenRowAvx2(const uint32_t* src, uint32_t* dst, int count, int factor)
+{
+  __m256i index[MAX_UPSCALE];
+  for (int k = 0; k < factor; k++)
+  {
+    int lane[8];
+    for (int j = 0; j < 8; j++) lane[j] = (8 * k + j) / factor;
+    index[k] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lane));
+  }
+
+  int i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    __m256i* out = reinterpret_cast<__m256i*>(dst + i * factor);
+    for (int k = 0; k < factor; k++)
+    {
+      _mm256_storeu_si256(out + k, _mm256_permutevar8x32_epi32(p, index[k]));
+    }
+  }
+  widenRowScalar(src + i, dst + i * factor, count - i, factor);
+}
+
+__attribute__((target("avx2")))
+inline __m256i blendPixelsAvx2(__m256i a, __m256i b, __m256i weight)
+{
+  const __m256i mask = _mm256_set1_epi32(0x00FF00FF);
+  const __m256i rest = _mm256_sub_epi16(_mm256_set1_epi16(256), weight);
+  __m256i rb = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_and_si256(a, mask), rest), _mm256_mullo_epi16(_mm256_and_si256(b, mask), weight));
+  __m256i ag = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_srli_epi16(a, 8), rest), _mm256_mullo_epi16(_mm256_srli_epi16(b, 8), weight));
+  return _mm256_or_si256(_mm256_srli_epi16(rb, 8), _mm256_andnot_si256(mask, ag));
+}
+
+__attribute__((target("avx2")))
+inline void blendRowsAvx2(const uint32_t* a, const uint32_t* b, uint32_t* dst, int count, int weight)
+{
+  const __m256i w = _mm256_set1_epi16(static_cast<short>(weight));
+  int i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256i pa = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i pb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), blendPixelsAvx2(pa, pb, w));
+  }
+  blendRowsScalar(a + i, b + i, dst + i, count - i, weight);
+}
+
+// Both pixels of every output pixel are gathered, from the row staying in L1
+__attribute__((target("avx2")))
+inline void interpolateRowAvx2(const uint32_t* src, const int* columns, const uint32_t* weights, uint32_t* dst, int count)
+{
+  const int* row = reinterpret_cast<const int*>(src);
+  int i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(columns + i));
+    __m256i pa = _mm256_i32gather_epi32(row, c, 4);
+    __m256i pb = _mm256_i32gather_epi32(row + 1, c, 4);
+    __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), blendPixelsAvx2(pa, pb, w));
+  }
+  interpolateRowScalar(src, columns + i, weights + i, dst + i, count - i);
+}
+
+#endif
+
+/**
+ * The kernels of the upscaler, for one instruction set
+ **/
+struct UpscaleKernels
+{
+  void (*widen)(const uint32_t* src, uint32_t* dst, int count, int factor);
+  void (*blend)(const uint32_t* a, const uint32_t* b, uint32_t* dst, int count, int weight);
+  void (*interpolate)(const uint32_t* src, const int* columns, const uint32_t* weights, uint32_t* dst, int count);
+};
+
+const UpscaleKernels UPSCALE_SCALAR = {widenRowScalar, blendRowsScalar, interpolateRowScalar};
+#ifdef LXF_X86
+const UpscaleKernels UPSCALE_SSE2 = {widenRowSse2, blendRowsSse2, interpolateRowSse2};
+const UpscaleKernels UPSCALE_AVX2 = {widenRowAvx2, blendRowsAvx2, interpolateRowAvx2};
+#endif
+
+/**
+ * Picks the fastest kernels for the given tier, the one of the CPU by default.
+ * There are no AVX-512 ones, that tier gets the AVX2 kernels.
+ **/
+inline UpscaleKernels selectUpscaleKernels(CpuTier tier = cpuTier())
+{
+#ifdef LXF_X86
+  if (tier >= CPU_AVX2) return UPSCALE_AVX2;
+  if (tier >= CPU_SSE2) return UPSCALE_SSE2;
+#endif
+  return UPSCALE_SCALAR;
+}
+
+/**
+ * Enlarges the indexed frames by an integer factor while expanding them through
+ * the palette, writing straight into the (locked) memory of a texture. Every row
+ * of the frame is expanded once, into a buffer staying in the cache:
+ *  - nearest: the row is widened, and the widened row is copied factor times,
+ *  - bilinear: the row is interpolated horizontally, then every row of the
+ *    output is blended from the two horizontally interpolated rows around it.
+ *    The blends are done in fixed point, with weights in 256ths.
+ * The output is only written, never read back. The sample positions are the
+ * centres of the pixels, and the edges are clamped.
+ **/
+class Upscaler
+{
+public:
+  explicit Upscaler(UpscaleKernels kernels = selectUpscaleKernels()) : kernels(kernels) {}
+
+  // dst has screen.width() * factor columns and screen.height() * factor rows, pitch bytes apart
+  void upscale(const Framebuffer& screen, const PaletteLut& lut, UpscaleFilter filter, int factor, uint8_t* dst, int pitch)
+  {
+    expanded.resize(screen.width() + 1);
+    if (filter == UPSCALE_BILINEAR)
+    {
+      bilinear(screen, lut, factor, dst, pitch);
+    }
+    else
+    {
+      nearest(screen, lut, factor, dst, pitch);
+    }
+  }
+
+private:
+  void nearest(const Framebuffer& screen, const PaletteLut& lut, int factor, uint8_t* dst, int pitch)
+  {
+    const int width = screen.width();
+    const size_t bytes = static_cast<size_t>(width) * factor * sizeof(uint32_t);
+    widened[0].resize(static_cast<size_t>(width) * factor);
+    for (int y = 0; y < screen.height(); y++)
+    {
+      expandPalette(screen.row(y), expanded.data(), width, lut);
+      kernels.widen(expanded.data(), widened[0].data(), width, factor);
+      for (int k = 0; k < factor; k++)
+      {
+        memcpy(dst + static_cast<size_t>(y * factor + k) * pitch, widened[0].data(), bytes);
+      }
+    }
+  }
+
+  void bilinear(const Framebuffer& screen, const PaletteLut& lut, int factor, uint8_t* dst, int pitch)
+  {
+    const int width = screen.width() * factor;
+    if (static_cast<int>(columns.size()) != width || columnFactor != factor)
+    {
+      columns.resize(width);
+      weights.resize(width);
+      for (int x = 0; x < width; x++)
+      {
+        int weight;
+        sample(x, factor, screen.width(), columns[x], weight);
+        weights[x] = weight | (weight << 16);
+      }
+      columnFactor = factor;
+    }
+
+    // Source rows y0 and y0 + 1 have different parities, so each has a slot of its own
+    int cached[2] = {-1, -1};
+    widened[0].resize(width);
+    widened[1].resize(width);
+    for (int y = 0; y < screen.height() * factor; y++)
+    {
+      int y0, weight;
+      sample(y, factor, screen.height(), y0, weight);
+      int y1 = std::min(y0 + 1, screen.height() - 1);
+      for (int row : {y0, y1})
+      {
+        if (cached[row & 1] != row)
+        {
+          interpolateRow(screen, lut, row, widened[row & 1].data());
+          cached[row & 1] = row;
+        }
+      }
+      kernels.blend(widened[y0 & 1].data(), widened[y1 & 1].data(), reinterpret_cast<uint32_t*>(dst + static_cast<size_t>(y) * pitch), width, weight);
+    }
+  }
+
+  // Expands the row of the screen and interpolates it horizontally into out
+  void interpolateRow(const Framebuffer& screen, const PaletteLut& lut, int y, uint32_t* out)
+  {
+    const int width = screen.width();
+    expandPalette(screen.row(y), expanded.data(), width, lut);
+    expanded[width] = expanded[width - 1];
+    kernels.interpolate(expanded.data(), columns.data(), weights.data(), out, static_cast<int>(columns.size()));
+  }
+
+  /**
+   * The pixel of the source (out of size) the centre of the output pixel i falls
+   * after, and how far after it, in 256ths
+   **/
+  static void sample(int i, int factor, int size, int& first, int& weight)
+  {
+    int position = (2 * i + 1) * 256 / (2 * factor) - 128;
+    first = position >> 8;
+    weight = position & 255;
+    if (first < 0)
+    {
+      first = 0;
+      weight = 0;
+    }
+    else if (first >= size - 1)
+    {
+      first = size - 1;
+      weight = 0;
+    }
+  }
+
+  UpscaleKernels kernels;
+  std::vector<uint32_t> expanded;       // One row of the screen expanded, and its last pixel once more
+  std::vector<uint32_t> widened[2];     // Rows of the screen enlarged horizontally
+  std::vector<int> columns;             // Bilinear: the source column every output column starts from
+  std::vector<uint32_t> weights;        // and the weight of the one after it, twice
+  int columnFactor = 0;
+};
@@ -0,0 +1,38 @@
+#include <string>
+#include <vector>
+
+#include "sdl_presenter.h"
+#include "sequencer.h"
+
+int main(int argc, char* argv[])
+{
+  // The timeline and the assets are for the demo, the rest of the options go to the host
+  std::string script = "demo.txt";
+  std::string root = "..";
+  std::vector<char*> hostArguments = {argv[0]};
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--script" && i + 1 < argc)
+    {
+      script = argv[++i];
+    }
+    else if (arg == "--root" && i + 1 < argc)
+    {
+      root = argv[++i];
+    }
+    else
+    {
+      hostArguments.push_back(argv[i]);
+    }
+  }
+
+  std::vector<SequenceEntry> timeline;
+  if (!loadSequence(script, timeline))
+  {
+    return EXIT_FAILURE;
+  }
+
+  SequenceEffect demo(timeline, root);
+  return runEffectMain(demo, static_cast<int>(hostArguments.size()), hostArguments.data());
+}
@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "all_effects.h"
+#include "effect.h"
+#include "framebuffer.h"
+#include "thread_pool.h"
+
+/**
+ * The settings of a render
+ **/
+struct FarmOptions
+{
+  std::string effect;                 // The effect rendered, one drawing its frames on their own
+  long first = 0;                     // The first frame rendered
+  double start = -1;                  // Or the time of the first frame, in seconds, if not negative
+  long count = 0;                     // The number of frames, 0 renders up to the end of the effect
+  int width = 0;                      // The size of the frames, 0 uses the size the effect was written for
+  int height = 0;
+  int workers = 0;                    // Threads (or processes) rendering the frames, 0 uses all the cores
+  bool processes = false;             // Render in processes instead of threads
+  std::string root = "..";            // The top directory of the repository, for the assets
+  std::string dir = "frames";         // Where the frames are written
+};
+
+/**
+ * The name of the file of the given frame, numbered so that ffmpeg -i NAME_%06d.ppm reads them in order
+ **/
+inline std::string frameFilename(const FarmOptions& options, long frame)
+{
+  char number[32];
+  snprintf(number, sizeof(number), "_%06ld.ppm", frame);
+  return options.dir + "/" + options.effect + number;
+}
+
+/**
+ * Writes the screen with its palette into a binary PPM file, in one write
+ **/
+inline bool writePpm(const std::string& filename, const Framebuffer& screen, const Palette& palette, std::vector<uint8_t>& output)
+{
+  char header[64];
+  int headerLength = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", screen.width(), screen.height());
+
+  output.resize(headerLength + static_cast<size_t>(screen.width()) * screen.height() * 3);
+  std::copy(header, header + headerLength, output.begin());
+  uint8_t* dst = output.data() + headerLength;
+  for (int y = 0; y < screen.height(); y++)
+  {
+    const uint8_t* src = screen.row(y);
+    for (int x = 0; x < screen.width(); x++, dst += 3)
+    {
+      const Colour& c = palette[src[x]];
+      dst[0] = c.r;
+      dst[1] = c.g;
+      dst[2] = c.b;
+    }
+  }
+
+  FILE* file = fopen(filename.c_str(), "wb");
+  if (!file)
+  {
+    std::cerr << "Cannot create the frame:" << filename << std::endl;
+    return false;
+  }
+  bool written = fwrite(output.data(), 1, output.size(), file) == output.size();
+  written = fclose(file) == 0 && written;
+  if (!written)
+  {
+    std::cerr << "Cannot write the frame:" << filename << std::endl;
+  }
+  return written;
+}
+
+/**
+ * The loop of a worker: draws the frames handed out by next (or, when it is null,
+ * every workers-th frame from the worker-th one) on a screen of its own, and
+ * writes them. Returns false if a frame could not be drawn or written.
+ **/
+inline bool renderFrames(const Effect& effect, const FarmOptions& options, int width, int height, int worker, int workers, std::atomic<long>* next)
+{
+  Framebuffer screen(width, height);
+  std::vector<uint8_t> output;
+  for (long i = worker; ; i += workers)
+  {
+    long index = next ? next->fetch_add(1, std::memory_order_relaxed) : i;
+    if (index >= options.count)
+    {
+      return true;
+    }
+
+    long frame = options.first + index;
+    if (!effect.drawFrame(screen, frame))
+    {
+      std::cerr << "Cannot draw frame " << frame << " of " << options.effect << std::endl;
+      return false;
+    }
+    if (!writePpm(frameFilename(options, frame), screen, effect.palette(), output))
+    {
+      return false;
+    }
+  }
+}
+
+/**
+ * Renders the frames on threads, which take the next frame not yet rendered when
+ * they are done with one, so the slow frames do not hold up the others
+ **/
+inline bool renderOnThreads(const Effect& effect, const FarmOptions& options, int width, int height)
+{
+  std::atomic<long> next(0);
+  std::atomic<bool> failed(false);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < options.workers; i++)
+  {
+    threads.emplace_back([&, i] {
+      if (!renderFrames(effect, options, width, height, i, options.workers, &next))
+      {
+        failed.store(true, std::memory_order_relaxed);
+        next.store(options.count, std::memory_order_relaxed);
+      }
+    });
+  }
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+  return !failed.load(std::memory_order_relaxed);
+}
+
+/**
+ * Renders the frames in child processes, each taking every workers-th frame. The
+ * effect is initialized before the fork, so the children share its assets.
+ **/
+inline bool renderInProcesses(const Effect& effect, const FarmOptions& options, int width, int height)
+{
+#ifdef __linux__
+  std::vector<pid_t> children;
+  bool failed = false;
+  for (int i = 0; i < options.workers; i++)
+  {
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+      _exit(renderFrames(effect, options, width, height, i, options.workers, nullptr) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    if (pid < 0)
+    {
+      std::cerr << "Cannot start worker process " << i << std::endl;
+      failed = true;
+      break;
+    }
+    children.push_back(pid);
+  }
+
+  for (pid_t child : children)
+  {
+    int status = 0;
+    if (waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+    {
+      failed = true;
+    }
+  }
+  return !failed;
+#else
+  std::cerr << "Rendering in processes is only supported on Linux" << std::endl;
+  return false;
+#endif
+}
+
+inline bool parseFarmOptions(int argc, char* argv[], FarmOptions& options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--effect" && i + 1 < argc) options.effect = argv[++i];
+    else if (arg == "--first" && i + 1 < argc) options.first = std::atol(argv[++i]);
+    else if (arg == "--start" && i + 1 < argc) options.start = std::atof(argv[++i]);
+    else if (arg == "--count" && i + 1 < argc) options.count = std::atol(argv[++i]);
+    else if (arg == "--width" && i + 1 < argc) options.width = std::atoi(argv[++i]);
+    else if (arg == "--height" && i + 1 < argc) options.height = std::atoi(argv[++i]);
+    else if (arg == "--workers" && i + 1 < argc) options.workers = std::atoi(argv[++i]);
+    else if (arg == "--processes") options.processes = true;
+    else if (arg == "--root" && i + 1 < argc) options.root = argv[++i];
+    else if (arg == "--dir" && i + 1 < argc) options.dir = argv[++i];
+    else
+    {
+      options.effect.clear();
+      break;
+    }
+  }
+
+  if (options.effect.empty() || options.first < 0 || options.count < 0)
+  {
+    std::cerr << "Usage: " << argv[0] << " --effect NAME [--first N | --start SECONDS] [--count N] [--width W] [--height H] [--workers N] [--processes] [--root DIR] [--dir DIR]" << std::endl;
+    std::cerr << "Effects:";
+    for (const auto& name : effectNames()) std::cerr << " " << name;
+    std::cerr << std::endl;
+    return false;
+  }
+
+  if (options.workers <= 0)
+  {
+    options.workers = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  }
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  FarmOptions options;
+  if (!parseFarmOptions(argc, argv, options))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Every worker draws whole frames, splitting them into bands as well would only make them wait for each other
+  setThreadCount(1);
+
+  auto effect = makeEffect(options.effect, options.root);
+  if (!effect)
+  {
+    std::cerr << "Unknown effect: " << options.effect << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  int width = options.width > 0 ? options.width : effect->width();
+  int height = options.height > 0 ? options.height : effect->height();
+  Framebuffer screen(width, height);
+  if (!effect->resize(screen))
+  {
+    width = effect->width();
+    height = effect->height();
+    screen.resize(width, height);
+    effect->resize(screen);
+  }
+  if (!effect->init(screen))
+  {
+    std::cerr << "Cannot initialize effect: " << options.effect << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (options.start >= 0)
+  {
+    options.first = effect->frameAt(options.start);
+  }
+
+  if (!effect->drawFrame(screen, options.first))
+  {
+    std::cerr << options.effect << " builds every frame on the one before, it cannot draw frame " << options.first << " on its own" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  long frames = effect->frameCount();
+  if (options.count == 0)
+  {
+    if (frames == 0)
+    {
+      std::cerr << options.effect << " goes on until it is stopped, --count is needed" << std::endl;
+      return EXIT_FAILURE;
+    }
+    options.count = frames - options.first;
+  }
+  else if (frames > 0)
+  {
+    options.count = std::min(options.count, frames - options.first);
+  }
+
+  std::error_code error;
+  std::filesystem::create_directories(options.dir, error);
+  if (error)
+  {
+    std::cerr << "Cannot create the directory:" << options.dir << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  bool rendered = options.processes ? renderInProcesses(*effect, options, width, height)
+                                    : renderOnThreads(*effect, options, width, height);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (!rendered)
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Rendered frames " << options.first << "-" << options.first + options.count - 1 << " of " << options.effect
+            << " at " << width << "x" << height << " on " << options.workers << (options.processes ? " processes" : " threads")
+            << " in " << seconds << " s (" << options.count / seconds << " frames/s) into " << options.dir << std::endl;
+  return EXIT_SUCCESS;
+}
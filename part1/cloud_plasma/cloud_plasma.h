@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "effect.h"
+#include "framebuffer.h"
+#include "palette_cycler.h"
+
+namespace cloud_plasma {
+
+// The size of the screen the effect was written for
+const int DEFAULT_SCREENSIZE_X = 640;
+const int DEFAULT_SCREENSIZE_Y = 480;
+
+const int XMIN = 0;
+const int YMIN = 2;
+const double RANDMONESS = 1.7;  // Play with this for more fun. The higher the value, the more pixelated the cloud is
+const double MAXIMUM_RANDOM = static_cast<double>(RAND_MAX);
+
+/**
+ * This is the diamond step in the Diamond-Square algorithm.
+ * This function is responsible for adjusting the midpoint of
+ * a line (either horizontal or vertical) between two given points. 
+ * It calculates the midpoint value by averaging the values of the 
+ * The rf factor controls the degree of randomness in the displacement.
+*/
+inline void diamondStep(int x1, int y1, int x, int y, int x2, int y2, double rf, Framebuffer& screen) 
+{
+  if (screen.getPixel(x, y) != 0) 
+  {
+    return;
+  }
+
+  int d = abs(x1 - x2) + abs(y1 - y2);
+  // calculate a new colour
+  int v = static_cast<int>((screen.getPixel(x1, y1) + screen.getPixel(x2, y2)) / 2 + (rand() / MAXIMUM_RANDOM - 0.5) * d * rf);
+  v = std::clamp(v, 1, 255); // Ensure v is within the valid range
+
+  screen.putPixel(x, y, static_cast<uint8_t>(v));
+}
+
+/**
+ * This function recursively subdivides the terrain represented by the input square 
+ * defined by (x1, y1) and (x2, y2). 
+ * It then calls the diamondStep function for each edge of the square and calculates 
+ * the midpoint value for the center of the square if it hasn't been set already. 
+ * The terrain is further subdivided into smaller squares until a certain size 
+ * is reached, at which point the recursion stops.
+ **/
+inline void squareStep(int x1, int y1, int x2, int y2, Framebuffer& screen) 
+{
+  if((x2 - x1 < 2) && (y2 - y1 < 2)) 
+  {
+    return;
+  }
+
+  int x = (x1 + x2) / 2;
+  int y = (y1 + y2) / 2;
+
+  diamondStep(x1, y1, x, y1, x2, y1, RANDMONESS, screen);
+  diamondStep(x2, y1, x2, y, x2, y2, RANDMONESS, screen);
+  diamondStep(x1, y2, x, y2, x2, y2, RANDMONESS, screen);
+  diamondStep(x1, y1, x1, y, x1, y2, RANDMONESS, screen);
+
+  if (screen.getPixel(x, y) == 0) 
+  {
+    double v = (screen.getPixel(x1, y1) + screen.getPixel(x2, y1) +
+                screen.getPixel(x2, y2) + screen.getPixel(x1, y2)) /
+               4.0;
+    screen.putPixel(x, y, static_cast<uint8_t>(v));
+  }
+
+  squareStep(x1, y1, x, y, screen);
+  squareStep(x, y1, x2, y, screen);
+  squareStep(x, y, x2, y2, screen);
+  squareStep(x1, y, x, y2, screen);
+}
+
+// The cloud covers the whole screen, whatever its size
+inline void initializeScreen(Framebuffer& screen) {
+  const int xmax = screen.width() - 1;
+  const int ymax = screen.height() - 1;
+  screen.putPixel(0, 0, 1 + rand() % 255);
+  screen.putPixel(xmax, 0, 1 + rand() % 255);
+  screen.putPixel(xmax, ymax, 1 + rand() % 255);
+  screen.putPixel(0, ymax, 1 + rand() % 255);
+  squareStep(0, 0, xmax, ymax, screen);
+}
+
+inline void generateColorCyclePalette(Colour* colours) {
+    // Set the main colors at specific indices
+    colours[0].r = 0;
+    colours[0].g = 0;
+    colours[0].b = 0;
+    colours[0].a = 255; // Black
+
+    colours[85].r = 255;
+    colours[85].g = 165; // RGB values for orange
+    colours[85].b = 0;
+    colours[85].a = 255; // Orange
+
+    colours[170].r = 0;
+    colours[170].g = 255;
+    colours[170].b = 255;
+    colours[170].a = 255; // Cyan
+
+    // Generate transitional shades between the main colors
+    for (int i = 1; i < 85; ++i) {
+        float ratio = static_cast<float>(i) / 85.0f;
+
+        colours[i].r = static_cast<uint8_t>((1.0f - ratio) * colours[0].r + ratio * colours[85].r);
+        colours[i].g = static_cast<uint8_t>((1.0f - ratio) * colours[0].g + ratio * colours[85].g);
+        colours[i].b = static_cast<uint8_t>((1.0f - ratio) * colours[0].b + ratio * colours[85].b);
+        colours[i].a = 255; // Alpha value, fully opaque
+    }
+
+    for (int i = 86; i < 170; ++i) {
+        float ratio = static_cast<float>(i - 85) / 84.0f;
+
+        colours[i].r = static_cast<uint8_t>((1.0f - ratio) * colours[85].r + ratio * colours[170].r);
+        colours[i].g = static_cast<uint8_t>((1.0f - ratio) * colours[85].g + ratio * colours[170].g);
+        colours[i].b = static_cast<uint8_t>((1.0f - ratio) * colours[85].b + ratio * colours[170].b);
+        colours[i].a = 255; // Alpha value, fully opaque
+    }
+
+    for (int i = 171; i < 256; ++i) {
+        float ratio = static_cast<float>(i - 170) / 85.0f;
+
+        colours[i].r = static_cast<uint8_t>((1.0f - ratio) * colours[170].r + ratio * colours[0].r);
+        colours[i].g = static_cast<uint8_t>((1.0f - ratio) * colours[170].g + ratio * colours[0].g);
+        colours[i].b = static_cast<uint8_t>((1.0f - ratio) * colours[170].b + ratio * colours[0].b);
+        colours[i].a = 255; // Alpha value, fully opaque
+    }
+}
+
+/**
+ * The plasma generated with the Diamond-Square algorithm, brought to life by
+ * cycling its palette
+ **/
+class CloudPlasmaEffect : public Effect
+{
+public:
+  const char* title() const override { return "Cloud Plasma"; }
+  int width() const override { return DEFAULT_SCREENSIZE_X; }
+  int height() const override { return DEFAULT_SCREENSIZE_Y; }
+  double updateRate() const override { return 100; }
+
+  bool resize(Framebuffer& screen) override
+  {
+    // The cloud is drawn only once, a new one is needed for the new size
+    if (initialized)
+    {
+      initializeScreen(screen);
+    }
+    return true;
+  }
+
+  bool init(Framebuffer& screen) override
+  {
+    generateColorCyclePalette(colours.data());
+    cycler.setColours(colours);
+    cycler.clearRanges();
+    cycler.addRange(CycleRange{0, 255, 1});
+
+    screen.clear();
+    initializeScreen(screen);
+    initialized = true;
+
+    // The cloud is only drawn again when the screen is resized, which marks it all as changed
+    screen.trackDamage();
+    return true;
+  }
+
+  bool update(Framebuffer& screen) override
+  {
+    cycler.advance();
+    cycler.apply(colours);
+    return true;
+  }
+
+  // The screen is drawn once, what moves is the palette
+  bool saveState(StateWriter& state) const override
+  {
+    cycler.saveState(state);
+    return true;
+  }
+
+  bool loadState(StateReader& state) override
+  {
+    return cycler.loadState(state);
+  }
+
+private:
+  PaletteCycler cycler;
+  bool initialized = false;
+};
+
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+
+#include "effect.h"
+#include "framebuffer.h"
+#include "palette_cycler.h"
+
+namespace colour_cycling {
+
+// The size of the screen, for this situation it will be 512x512
+const int SCREENSIZE_X = 512;
+const int SCREENSIZE_Y = 512;
+
+/**
+ * Will generate the palette for the color cycling. The palette will be
+ * emulating some stripes, of red, green, blue colours
+ **/
+inline void generateColorCyclePalette(Colour* colours)
+{
+  for(int i = 0; i < 256; i++) {
+    colours[i] = Colour{0, 0, 0, 0};
+  }
+  for(int i = 0; i < 32; i++) {
+    colours[i + 32] = Colour{static_cast<uint8_t>(i * 8), 0, 0, 0};
+  }
+  for(int i = 0; i < 32; i++) {
+    colours[i + 64] = Colour{static_cast<uint8_t>(255 - i * 8), 0, 0, 0};
+  }
+
+  for(int i = 0; i < 32; i++) {
+    colours[i + 128] = Colour{0, 0, static_cast<uint8_t>(i * 8), 0};
+  }
+  for(int i = 0; i < 32; i++) {
+    colours[i + 160] = Colour{0, 0, static_cast<uint8_t>(255 - i * 8), 0};
+  }
+}
+
+
+/**
+ * Will draw the initial screen. We aim for something that looks like a tunnel, or similar
+ **/
+inline void initializeScreen(Framebuffer& screen) {
+  for (int x = 0; x < SCREENSIZE_X; x++) {
+    for (int y = x; y < SCREENSIZE_Y - x ; y++) {
+      screen.putPixel(x, y, x % 255);
+      screen.putPixel(y, x, x  % 255);
+      screen.putPixel(SCREENSIZE_X - x, y, x % 255);
+    }
+  }
+}
+
+/**
+ * A tunnel which is never redrawn, only its palette is rotated
+ **/
+class ColourCyclingEffect : public Effect
+{
+public:
+  const char* title() const override { return "Colour cycling"; }
+  int width() const override { return SCREENSIZE_X; }
+  int height() const override { return SCREENSIZE_Y; }
+  double updateRate() const override { return 100; }
+
+  bool init(Framebuffer& screen) override
+  {
+    // Let's generate a palette. The black background stays, everything else moves
+    generateColorCyclePalette(colours.data());
+    cycler.setColours(colours);
+    cycler.clearRanges();
+    cycler.addRange(CycleRange{1, 255, 1});
+
+    // Let's draw the initial screen
+    screen.clear();
+    initializeScreen(screen);
+
+    // The pixels never change again, only the palette
+    screen.trackDamage();
+    return true;
+  }
+
+  bool update(Framebuffer& screen) override
+  {
+    // Rotate the palette, in a way that it emulates the forward movement
+    cycler.advance();
+    cycler.apply(colours);
+    return true;
+  }
+
+  // The screen is drawn once, what moves is the palette
+  bool saveState(StateWriter& state) const override
+  {
+    cycler.saveState(state);
+    return true;
+  }
+
+  bool loadState(StateReader& state) override
+  {
+    return cycler.loadState(state);
+  }
+
+private:
+  PaletteCycler cycler;
+};
+
+}
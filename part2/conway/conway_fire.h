@@ -0,0 +1,426 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "effect.h"
+#include "framebuffer.h"
+#include "random.h"
+#include "thread_pool.h"
+
+namespace conway {
+
+// The size of the screen the effect was written for
+const int DEFAULT_SCREENSIZE_X = 640;
+const int DEFAULT_SCREENSIZE_Y = 480;
+
+const int XMIN = 0;
+const int YMIN = 2;
+const int FIRE_HEIGHT = 2;
+const int CONWAY_DIFFERENTIATOR = 128;
+
+/**
+ * Will generate the red components of the fire palette
+ **/
+inline std::vector<uint8_t> generateReds() {
+  std::vector<uint8_t> result;
+
+  for (int i = 0; i < 18; ++i) {
+    result.push_back(0);
+  }
+
+  for (int i = 1; i <= 16; ++i) {
+    result.push_back(i * 8);
+  }
+  int count = 128;
+
+  for (int i = 0; i <= 7; ++i) {
+    result.push_back(count);
+    if (count == 176) {
+      count += 4;
+      result.push_back(count);
+      continue;
+    }
+    for (int j = 0; j < 4; ++j) {
+      count += 4;
+      result.push_back(count);
+    }
+  }
+  count = 252;
+  while (result.size() <= 256) result.push_back(count);
+
+  return result;
+}
+
+/**
+ * Will generate the green components of the fire palette
+ **/
+inline std::vector<uint8_t> generateGreens() {
+  std::vector<uint8_t> result;
+
+  // Add 20 zeros
+  for (int i = 0; i < 40; ++i) {
+    result.push_back(0);
+  }
+
+  // Add numbers in the pattern 4, 8, 12, ..., 252
+  for (int i = 4; i <= 252; i += 4) {
+    result.push_back(i);
+    result.push_back(i);
+  }
+
+  int count = 252;
+  while (result.size() <= 256) result.push_back(count);
+
+  return result;
+}
+
+/**
+ * Will generate the blue components of the fire palette
+ **/
+inline std::vector<uint8_t> generateBlues() {
+  std::vector<uint8_t> result;
+
+  result.push_back(0);
+
+  for (int i = 0; i < 36; ++i) {
+    result.push_back(i * 2);
+  }
+
+  for (int i = 18; i >= 0; i--) {
+    result.push_back(i);
+    result.push_back(i);
+  }
+
+  int i = 0;
+
+  while (result.size() < 144) result.push_back(i++);
+
+  for (int i = 0; i < 54; ++i) {
+    result.push_back(i);
+    result.push_back(i);
+  }
+
+  int count = 252;
+  while (result.size() <= 256) result.push_back(count);
+
+  return result;
+}
+
+/**
+ * Will generate the fire palette
+ **/
+inline void generateFirePalette(Colour* colours, int count) {
+  auto reds = generateReds();
+  auto greens = generateGreens();
+  auto blues = generateBlues();
+
+  for (int i = 0; i < count; i++) {
+    colours[i] = Colour{reds[i], greens[i], blues[i], 255};
+  }
+}
+
+/**
+ * This routine will be called when the application initializes the screen for the effects
+ **/
+inline void initializeScreen(Framebuffer& screen)
+{
+  // reset the screen to 0
+  screen.clear();
+
+  // Initialize the last row of the screen with random values (0 or 255).
+  const int xmax = screen.width() - 1;
+  const int ymax = screen.height() - 1;
+  for (int x = XMIN; x <= xmax; ++x) 
+  {
+    screen.row(ymax)[x] = rand() % 255;
+  }
+}
+
+// The fire and the Game of Life are calculated in bands of this many columns, in parallel
+const int BAND_WIDTH = 64;
+
+// The random bits of a column are generated for this many pixels at a time
+const int RANDOM_CHUNK = 64;
+
+// The streams of random bits used by a pixel
+enum { STREAM_BOTTOM, STREAM_LIFE, STREAM_FIRE, STREAM_SPARKLE };
+
+/**
+ * A sparkle found while calculating a band. Sparkles can land anywhere on the
+ * screen, so they are only drawn once all the bands are done.
+ **/
+struct Sparkle
+{
+  int x, y;
+  uint8_t colour;
+};
+
+/**
+ * Applies the rules of Conway's Game of Life to the columns [first, last)
+ **/
+inline void lifeColumns(Framebuffer& screen, int first, int last, const CounterRandom& random, uint32_t frame)
+{
+  const int ymax = screen.height() - 1;
+  for (int x = first; x < last; ++x)
+  {
+    for (int y = YMIN + 1; y < ymax; ++y)
+    {
+      int neighbours = (screen.row(y - 1)[x] > CONWAY_DIFFERENTIATOR ? 0 : 1) +
+        (screen.row(y + 1)[x] > CONWAY_DIFFERENTIATOR ? 0 : 1) +
+        (screen.row(y)[x - 1] > CONWAY_DIFFERENTIATOR ? 0 : 1) +
+        (screen.row(y)[x + 1] > CONWAY_DIFFERENTIATOR ? 0 : 1) +
+        (screen.row(y - 1)[x - 1] > CONWAY_DIFFERENTIATOR ? 0 : 1) +
+        (screen.row(y - 1)[x + 1] > CONWAY_DIFFERENTIATOR ? 0 : 1) +
+        (screen.row(y + 1)[x - 1] > CONWAY_DIFFERENTIATOR ? 0 : 1) +
+        (screen.row(y + 1)[x + 1] > CONWAY_DIFFERENTIATOR ? 0 : 1);
+
+      if (screen.row(y)[x] < CONWAY_DIFFERENTIATOR) 
+      {
+        // Cell is alive
+        if (neighbours < 2 || neighbours > 3) 
+        {
+          RandomBits bits = random(frame, x, y, STREAM_LIFE);
+          int total = 0;
+          int tdivctr = 1;
+          total += screen.row(y + 1)[x - 1];
+          if (randomTenth(bits.byte(0)) < 2) 
+          {
+            total += screen.row(y + 1)[x];
+            tdivctr++;
+          }
+          if (randomTenth(bits.byte(1)) < 8) 
+          {
+            total += screen.row(y + 1)[x + 1];
+            tdivctr++;
+          }
+          if (randomTenth(bits.byte(2)) < 5) 
+          {
+            total += screen.row(y)[x - 1];
+            tdivctr++;
+          }
+          if (randomTenth(bits.byte(3)) < 7) 
+          {
+            total += screen.row(y)[x];
+            tdivctr++;
+          }
+          if (randomTenth(bits.byte(4)) < 5) 
+          {
+            total += screen.row(y)[x + 1];
+            tdivctr++;
+          }
+          uint8_t a = static_cast<uint8_t>( total / (tdivctr + (randomTenth(bits.byte(5)) < 2 ? 1 : 0)));
+          screen.row(y)[x] = a;  // Cell dies
+        }
+      } 
+      else 
+      {
+        // Cell is dead
+        if (neighbours == 3) 
+        {
+          screen.row(y)[x] = 255;  // Cell becomes alive
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Calculates the heavily randomized fire in the columns [first, last)
+ **/
+inline void fireColumns(Framebuffer& screen, int first, int last, const CounterRandom& random, uint32_t frame, std::vector<Sparkle>& sparkles)
+{
+  const int width = screen.width();
+  const int height = screen.height();
+  const int ymax = height - 1;
+  RandomBits chunk[RANDOM_CHUNK];
+  for (int x = first; x < last; x++) 
+  {
+    for (int y = YMIN; y < ymax; y++) 
+    {
+      if ((y - YMIN) % RANDOM_CHUNK == 0)
+      {
+        random.column(frame, x, y, std::min(RANDOM_CHUNK, ymax - y), STREAM_FIRE, chunk);
+      }
+      const RandomBits& bits = chunk[(y - YMIN) % RANDOM_CHUNK];
+      int total = 0;
+      int tdivctr = 1;
+      total += screen.row(y + 1)[x - 1];
+      if (randomTenth(bits.byte(0)) < 2) 
+      {
+        total += screen.row(y + 1)[x];
+        tdivctr++;
+      }
+      if (randomTenth(bits.byte(1)) < 8) 
+      {
+        total += screen.row(y + 1)[x + 1];
+        tdivctr++;
+      }
+      if (randomTenth(bits.byte(2)) < 5) 
+      {
+        total += screen.row(y)[x - 1];
+        tdivctr++;
+      }
+      if (randomTenth(bits.byte(3)) < 7) 
+      {
+        total += screen.row(y)[x];
+        tdivctr++;
+      }
+      if (randomTenth(bits.byte(4)) < 5) 
+      {
+        total += screen.row(y)[x + 1];
+        tdivctr++;
+      }
+      uint8_t a = static_cast<uint8_t>( total / tdivctr );
+
+      screen.row(y)[x] = a;
+      if (randomTenth(bits.byte(5)) < 5) screen.row(y)[x - 1] = a;
+      if (randomTenth(bits.byte(6)) < 5) screen.row(y)[x + 1] = a;
+      if (randomTenth(bits.byte(7)) < 5) screen.row(y - 1)[x] = a;
+      if (randomTenth(bits.byte(8)) < 5) screen.row(y - 2)[x] = a;
+
+      if(bits.byte(9) == 15 )
+      {
+          // The sparkle goes somewhere up and to the left, wrapped around to stay on the screen
+          RandomBits where = random(frame, x, y, STREAM_SPARKLE);
+          int rx = x - where.word[0] % width;
+          int ry = y - where.word[1] % height  ;
+          if(rx < 0) rx += width;
+          if(ry < 0) ry += height;
+          sparkles.push_back({rx, ry, static_cast<uint8_t>(where.word[2] % 255)});
+      }
+
+    }
+  }
+}
+
+/**
+ * Update screen is called for every frame that will be presented. The random bits
+ * of a pixel only depend on the seed, the frame and the position of the pixel,
+ * so the bands can be calculated on any number of threads with the same result.
+ **/
+inline void updateScreen(Framebuffer& screen, int& cycles, const CounterRandom& random, uint32_t frame, std::vector<std::vector<Sparkle>>& sparkles)
+{
+  const int xmax = screen.width() - 1;
+  const int ymax = screen.height() - 1;
+
+  // Adding another random row at the bottom of the screen
+  for (int x = XMIN; x <= xmax; ++x) 
+  {
+    RandomBits bits = random(frame, x, ymax, STREAM_BOTTOM);
+    switch (randomTenth(bits.byte(0))) 
+    {
+    case 0: case 2: case 4:
+      screen.row(ymax)[x] = 0;
+      break;
+    case 1: case 3: case 5: case 6: case 7:
+      screen.row(ymax)[x] = bits.word[1] % 255; 
+      break;
+    case 8: case 9:
+      screen.row(ymax)[x] = 255;
+      break;
+    }
+  }
+
+  ++cycles;
+  if (cycles == FIRE_HEIGHT + 1)
+  {
+    // If we have reached the desired height we apply the Conway's Game of Life rules.
+    cycles = 0;
+    parallelForColumnBands(XMIN, xmax, BAND_WIDTH, [&](int first, int last) {
+      lifeColumns(screen, first, last, random, frame);
+    });
+  }
+
+  // And here let's do a heavily randomized fire routine
+  // Every band has room for twice the sparkles it gets on average (one pixel in 256), so the frames do not allocate
+  sparkles.resize((xmax - XMIN + BAND_WIDTH) / BAND_WIDTH);
+  for (std::vector<Sparkle>& found : sparkles)
+  {
+    found.reserve(BAND_WIDTH * ymax / 128);
+  }
+  parallelForColumnBands(XMIN, xmax + 1, BAND_WIDTH, [&](int first, int last) {
+    std::vector<Sparkle>& found = sparkles[(first - XMIN) / BAND_WIDTH];
+    found.clear();
+    fireColumns(screen, first, last, random, frame, found);
+  });
+
+  for (const std::vector<Sparkle>& found : sparkles)
+  {
+    for (const Sparkle& sparkle : found)
+    {
+      if(screen.row(sparkle.y)[sparkle.x] >= 16)
+      {
+          screen.row(sparkle.y)[sparkle.x] = sparkle.colour;
+      }
+    }
+  }
+  // The flames spreading past the edges went into the guard bands
+  screen.clearGuards();
+}
+
+/**
+ * The fire routine, mixed with Conway's Game of Life
+ **/
+class ConwayFireEffect : public Effect
+{
+public:
+  const char* title() const override { return "Fire with Conway"; }
+  int width() const override { return DEFAULT_SCREENSIZE_X; }
+  int height() const override { return DEFAULT_SCREENSIZE_Y; }
+
+  // The fire burns on the whole screen, whatever its size
+  bool resize(Framebuffer& screen) override
+  {
+    return true;
+  }
+
+  bool init(Framebuffer& screen) override
+  {
+    // The palette that will be used for this scene
+    generateFirePalette(colours.data(), 255);
+    initializeScreen(screen);
+    cycles = 0;
+
+    // Seeded from rand(), so the same seed gives the same fire
+    random.reseed(static_cast<uint64_t>(rand()) << 32 | static_cast<uint32_t>(rand()));
+    frame = 0;
+    return true;
+  }
+
+  bool update(Framebuffer& screen) override
+  {
+    updateScreen(screen, cycles, random, frame++, sparkles);
+    return true;
+  }
+
+  // The fire and the cells are the screen, and the random bits of a frame only depend on the seed and its number
+  bool saveState(StateWriter& state) const override
+  {
+    state.write(cycles);
+    state.write(random.seed());
+    state.write(frame);
+    return true;
+  }
+
+  bool loadState(StateReader& state) override
+  {
+    uint64_t seed;
+    if (!state.read(cycles) || !state.read(seed) || !state.read(frame))
+    {
+      return false;
+    }
+    random.reseed(seed);
+    return true;
+  }
+
+private:
+  int cycles = 0;                               // The current iteration
+  CounterRandom random;                         // The random bits of the pixels
+  uint32_t frame = 0;                           // The number of the frame being calculated
+  std::vector<std::vector<Sparkle>> sparkles;   // The sparkles found in every band
+};
+
+}
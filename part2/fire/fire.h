@@ -0,0 +1,301 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "effect.h"
+#include "framebuffer.h"
+#include "random.h"
+#include "thread_pool.h"
+
+namespace fire {
+
+// The size of the screen the effect was written for
+const int DEFAULT_SCREENSIZE_X = 640;
+const int DEFAULT_SCREENSIZE_Y = 480;
+
+const int XMIN = 0;
+const int YMIN = 2;
+
+/**
+ * Will generate the red components of the fire palette
+ **/
+inline std::vector<uint8_t> generateReds() {
+  std::vector<uint8_t> result;
+
+  for (int i = 0; i < 8; ++i) {
+    result.push_back(0);
+  }
+
+  for (int i = 1; i <= 16; ++i) {
+    result.push_back(i * 8);
+  }
+  int count = 128;
+
+  for (int i = 0; i <= 7; ++i) {
+    result.push_back(count);
+    if (count == 176) {
+      count += 4;
+      result.push_back(count);
+      continue;
+    }
+    for (int j = 0; j < 4; ++j) {
+      count += 4;
+      result.push_back(count);
+    }
+  }
+  count = 252;
+  while (result.size() <= 256) result.push_back(count);
+
+  return result;
+}
+
+/**
+ * Will generate the green components of the fire palette
+ **/
+inline std::vector<uint8_t> generateGreens() {
+  std::vector<uint8_t> result;
+
+  // Add 20 zeros
+  for (int i = 0; i < 40; ++i) {
+    result.push_back(0);
+  }
+
+  // Add numbers in the pattern 4, 8, 12, ..., 252
+  for (int i = 4; i <= 252; i += 4) {
+    result.push_back(i);
+    result.push_back(i);
+  }
+
+  int count = 252;
+  while (result.size() <= 256) result.push_back(count);
+
+  return result;
+}
+
+/**
+ * Will generate the blue components of the fire palette
+ **/
+inline std::vector<uint8_t> generateBlues() {
+  std::vector<uint8_t> result;
+
+  result.push_back(0);
+
+  for (int i = 0; i < 36; ++i) {
+    result.push_back(i);
+    result.push_back(i);
+  }
+
+  for (int i = 18; i >= 0; i--) {
+    result.push_back(i * 2);
+    result.push_back(i * 2);
+  }
+
+  while (result.size() < 144) result.push_back(0);
+
+  for (int i = 0; i < 54; ++i) {
+    result.push_back(i * 4);
+    result.push_back(i * 4);
+  }
+
+  int count = 252;
+  while (result.size() <= 256) result.push_back(count);
+
+  return result;
+}
+
+/**
+ * Will generate the fire palette
+ **/
+inline void generateFirePalette(Colour* colours, int count) {
+  auto reds = generateReds();
+  auto greens = generateGreens();
+  auto blues = generateBlues();
+
+  for (int i = 0; i < count; i++) {
+    colours[i] = Colour{reds[i], greens[i], blues[i], 255};
+  }
+}
+
+/**
+ * This routine will be called when the application initializes the screen for the effects
+ **/
+inline void initializeScreen(Framebuffer& screen)
+{
+  // reset the screen to 0
+  screen.clear();
+}
+
+// The fire is calculated in bands of this many columns, in parallel
+const int BAND_WIDTH = 64;
+
+// The random bits of a column are generated for this many pixels at a time
+const int RANDOM_CHUNK = 64;
+
+// The streams of random bits used by a pixel
+enum { STREAM_BOTTOM, STREAM_FIRE, STREAM_SPARKLE };
+
+/**
+ * A sparkle found while calculating a band. Sparkles can land anywhere on the
+ * screen, so they are only drawn once all the bands are done.
+ **/
+struct Sparkle
+{
+  int x, y;
+  uint8_t colour;
+};
+
+/**
+ * Calculates the fire in the columns [first, last)
+ **/
+inline void updateColumns(Framebuffer& screen, int first, int last, const CounterRandom& random, uint32_t frame, std::vector<Sparkle>& sparkles)
+{
+  const int width = screen.width();
+  const int height = screen.height();
+  const int ymax = height - 1;
+  RandomBits chunk[RANDOM_CHUNK];
+  for (int x = first; x < last; x++) 
+  {
+    for (int y = YMIN; y < ymax; y++) 
+    {
+      if ((y - YMIN) % RANDOM_CHUNK == 0)
+      {
+        random.column(frame, x, y, std::min(RANDOM_CHUNK, ymax - y), STREAM_FIRE, chunk);
+      }
+      const RandomBits& bits = chunk[(y - YMIN) % RANDOM_CHUNK];
+
+      int total = 0;
+      int divc = 1;
+      total +=                  screen.getPixel(x-1, y+1);
+      if(bits.bit(0)) { total += screen.getPixel(x-1, y  ); divc ++; }
+      if(bits.bit(1)) { total += screen.getPixel(x-1, y-1); divc ++; }
+      if(bits.bit(2)) { total += screen.getPixel(x  , y-1); divc ++; }
+      if(bits.bit(3)) { total += screen.getPixel(x+1, y-1); divc ++; }
+      if(bits.bit(4)) { total += screen.getPixel(x+1, y  ); divc ++; }
+      if(bits.bit(5)) { total += screen.getPixel(x+1, y+1); divc ++; }
+      if(bits.bit(6)) { total += screen.getPixel(x  , y+1); divc ++; }
+      uint8_t avg = static_cast<uint8_t>( total / divc );
+
+      screen.putPixel               (x  , y  , avg);
+      if(bits.bit(7)) screen.putPixel(x-1, y  , avg);
+      if(bits.bit(8)) screen.putPixel(x+1, y  , avg);
+      if(bits.bit(9)) screen.putPixel(x  , y-1, avg);
+
+      // This will add some sparkles to the screen
+      if(bits.byte(4) == 15 )
+      {
+          // The sparkle goes somewhere up and to the left, wrapped around to stay on the screen
+          RandomBits where = random(frame, x, y, STREAM_SPARKLE);
+          int rx = x - where.word[0] % width;
+          int ry = y - where.word[1] % height  ;
+          if(rx < 0) rx += width;
+          if(ry < 0) ry += height;
+          sparkles.push_back({rx, ry, static_cast<uint8_t>(where.word[2] % 255)});
+      }
+
+    }
+  }
+}
+
+/**
+ * Update screen is called for every frame that will be presented. The random bits
+ * of a pixel only depend on the seed, the frame and the position of the pixel,
+ * so the bands can be calculated on any number of threads with the same result.
+ **/
+inline void updateScreen(Framebuffer& screen, const CounterRandom& random, uint32_t frame, std::vector<std::vector<Sparkle>>& sparkles)
+{
+  const int xmax = screen.width() - 1;
+  const int ymax = screen.height() - 1;
+  for (int x = XMIN; x <= xmax; ++x) 
+  {
+    screen.row(ymax)[x] = random(frame, x, ymax, STREAM_BOTTOM).word[0] % 255;
+  }
+
+  // Every band has room for twice the sparkles it gets on average (one pixel in 256), so the frames do not allocate
+  sparkles.resize((xmax - XMIN + BAND_WIDTH) / BAND_WIDTH);
+  for (std::vector<Sparkle>& found : sparkles)
+  {
+    found.reserve(BAND_WIDTH * ymax / 128);
+  }
+  parallelForColumnBands(XMIN, xmax + 1, BAND_WIDTH, [&](int first, int last) {
+    std::vector<Sparkle>& found = sparkles[(first - XMIN) / BAND_WIDTH];
+    found.clear();
+    updateColumns(screen, first, last, random, frame, found);
+  });
+
+  for (const std::vector<Sparkle>& found : sparkles)
+  {
+    for (const Sparkle& sparkle : found)
+    {
+      if(screen.getPixel(sparkle.x, sparkle.y) >= 16)
+      {
+          screen.putPixel(sparkle.x, sparkle.y, sparkle.colour);
+      }
+    }
+  }
+  // The flames spreading past the edges went into the guard bands
+  screen.clearGuards();
+}
+
+/**
+ * The elementary fire routine
+ **/
+class FireEffect : public Effect
+{
+public:
+  const char* title() const override { return "Fire"; }
+  int width() const override { return DEFAULT_SCREENSIZE_X; }
+  int height() const override { return DEFAULT_SCREENSIZE_Y; }
+
+  // The fire burns on the whole screen, whatever its size
+  bool resize(Framebuffer& screen) override
+  {
+    return true;
+  }
+
+  bool init(Framebuffer& screen) override
+  {
+    // The palette that will be used for this scene
+    generateFirePalette(colours.data(), 255);
+    initializeScreen(screen);
+
+    // Seeded from rand(), so the same seed gives the same fire
+    random.reseed(static_cast<uint64_t>(rand()) << 32 | static_cast<uint32_t>(rand()));
+    frame = 0;
+    return true;
+  }
+
+  bool update(Framebuffer& screen) override
+  {
+    updateScreen(screen, random, frame++, sparkles);
+    return true;
+  }
+
+  // The fire is the screen, and the random bits of a frame only depend on the seed and its number
+  bool saveState(StateWriter& state) const override
+  {
+    state.write(random.seed());
+    state.write(frame);
+    return true;
+  }
+
+  bool loadState(StateReader& state) override
+  {
+    uint64_t seed;
+    if (!state.read(seed) || !state.read(frame))
+    {
+      return false;
+    }
+    random.reseed(seed);
+    return true;
+  }
+
+private:
+  CounterRandom random;                         // The random bits of the pixels
+  uint32_t frame = 0;                           // The number of the frame being calculated
+  std::vector<std::vector<Sparkle>> sparkles;   // The sparkles found in every band
+};
+
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "arena.h"
+#include "custom_image.h"
+#include "effect.h"
+#include "framebuffer.h"
+
+namespace swscroll {
+
+const int SCREENSIZE_X = 640;  // Adjust accordingly to your screen
+const int SCREENSIZE_Y = 400;
+const int XMIN = 0;
+const int XMAX = SCREENSIZE_X - 1;
+const int YMIN = 2;
+const int YMAX = SCREENSIZE_Y - 1;
+
+struct Star {
+    int x;
+    int y;
+};
+
+
+inline std::vector<Star> generateRandomStars(int numStars, int screenWidth, int screenHeight) {
+    std::vector<Star> stars;
+
+    // Seeded from rand(), so the same seed gives the same sky
+    std::mt19937 gen(rand());
+    std::uniform_int_distribution<int> xDistribution(0, screenWidth - 1);
+    std::uniform_int_distribution<int> yDistribution(0, screenHeight - 1);
+
+    for (int i = 0; i < numStars; ++i) {
+        Star star;
+        star.x = xDistribution(gen);
+        star.y = yDistribution(gen);
+        stars.push_back(star);
+    }
+
+    return stars;
+}
+
+
+/**
+ **/
+inline void starfield(Framebuffer& screen, const std::vector<Star>& stars)
+{
+  for(const auto& s : stars)
+  {
+    if(screen.getPixel(s.x, s.y) == 0 || screen.getPixel(s.x, s.y) == 153)
+    {
+      screen.putPixel(s.x, s.y, 255);
+    }
+  }
+}
+
+
+// Function to scale array length and interpolate content based on a percentage.
+// The result goes to scaledArray, which has room for originalLength values, and its length is returned.
+inline size_t scaleArray(const uint8_t* inputArray, size_t originalLength, double percentage, uint8_t* scaledArray) {
+    // Check for valid percentage
+    if (percentage < 0.0 || percentage > 100.0) {
+        memcpy(scaledArray, inputArray, originalLength);
+        return originalLength;
+    }
+
+    // Calculate the new length based on the percentage
+    size_t newLength = static_cast<size_t>(originalLength * (percentage / 100.0));
+
+    // Calculate interpolation step
+    double step = static_cast<double>(originalLength - 1) / static_cast<double>(newLength - 1);
+
+    // Interpolate values for the elements in the new array
+    for (size_t i = 0; i < newLength; ++i) {
+        double index = i * step;
+        size_t lowIndex = static_cast<size_t>(index);
+        if(lowIndex > originalLength) lowIndex = 0;
+        size_t highIndex = std::min(lowIndex + 1, originalLength - 1);
+        double fraction = index - lowIndex;
+
+        // Linear interpolation
+        scaledArray[i] = static_cast<uint8_t>((1.0 - fraction) * inputArray[lowIndex] + fraction * inputArray[highIndex]);
+    }
+
+    return newLength;
+}
+
+/**
+ * The galaxy far, far away scroller over a starfield
+ **/
+class StarWarsScrollEffect : public Effect
+{
+public:
+  explicit StarWarsScrollEffect(const std::string& assetPath = "output_image.custom") : assetPath(assetPath) {}
+
+  const char* title() const override { return "Star Wars Scroll"; }
+  int width() const override { return SCREENSIZE_X; }
+  int height() const override { return SCREENSIZE_Y; }
+  double updateRate() const override { return 10; }
+
+  // Around the text there is colour 0, and the text has a background of its own, the almost black 153
+  std::vector<uint8_t> transparentColours() const override { return {0, 153}; }
+
+  bool init(Framebuffer& screen) override
+  {
+    CustomImage text;
+    if (!loadCustomImage(assetPath, text)) {
+        return false;
+    }
+
+    text.applyPalette(colours);
+    colours[0] = {0, 0, 0, 0};
+    colours[255] = {255, 255, 255, 0};
+
+    screen.clear();
+
+    // Only the band of the text changes, the stars outside it stay where they are
+    screen.trackDamage();
+
+    arena.reset();
+    textBuffer = arena.allocate<uint8_t>(SCREENSIZE_X * SCREENSIZE_Y + 1, 0);
+    scaledRow = arena.allocate<uint8_t>(SCREENSIZE_X);
+    memcpy(textBuffer.data(), text.pixels(), std::min<size_t>(text.size(), SCREENSIZE_X * SCREENSIZE_Y));
+
+    // generate the starfield
+    stars = generateRandomStars(1024, SCREENSIZE_X, SCREENSIZE_Y);
+
+    currentRow = YMAX - 1;
+    textureEndRow = 1;
+    return true;
+  }
+
+  bool update(Framebuffer& screen) override
+  {
+    const int screenWidth = SCREENSIZE_X;
+    double beginScale = 100.0 - static_cast<double>(textureEndRow)/4.0  + 1.0;
+    for(int cr=0; cr<=textureEndRow; cr++)
+    {
+      memset(row, 0, SCREENSIZE_X);
+      if(beginScale < 0) beginScale = 0;
+      size_t length = scaleArray(textBuffer.data() + screenWidth * cr, screenWidth, beginScale, scaledRow.data());
+      if(cr % 4 == 0) beginScale += 1.0;
+      for(size_t j=0; j<length; j++) row[SCREENSIZE_X / 2 - length/2 + j] = scaledRow[j];
+      memcpy(screen.row(currentRow + cr), row, SCREENSIZE_X);
+    }
+    screen.markDirty(currentRow, currentRow + textureEndRow + 1);
+
+    textureEndRow ++;
+    currentRow --;
+
+    // starfield
+    starfield(screen, stars);
+
+    return textureEndRow != SCREENSIZE_Y;
+  }
+
+  // The text and the stars are set up by init(), only the rows of the text shown move
+  bool saveState(StateWriter& state) const override
+  {
+    state.write(currentRow);
+    state.write(textureEndRow);
+    return true;
+  }
+
+  bool loadState(StateReader& state) override
+  {
+    return state.read(currentRow) && state.read(textureEndRow);
+  }
+
+private:
+  std::string assetPath;
+  ArenaArray<uint8_t> textBuffer;
+  ArenaArray<uint8_t> scaledRow;    // The row of the text being scaled, so no frame allocates
+  std::vector<Star> stars;
+  uint8_t row[SCREENSIZE_X] = {0};
+  int currentRow = YMAX - 1;
+  int textureEndRow = 1;
+};
+
+}
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+
+#include "cpu_dispatch.h"
+#include "effect.h"
+#include "framebuffer.h"
+#include "screen_size.h"
+#include "thread_pool.h"
+
+namespace mandelzoom {
+
+// The size of the screen the effect was written for
+const int DEFAULT_SCREENSIZE_X = 320;
+const int DEFAULT_SCREENSIZE_Y = 200;
+
+inline uint8_t MANDELBROT_MAX_ITERATIONS = 255; // The maximum value, after which we consider the point "escaped". Handy that there are 256 colours.
+inline double MANDELBROT_THRESHOLD = 4.0; // This is 4.0, changing it has no real effect on the code.
+const double centerX = -0.743023954; // Center point on the real axis of the fractal at the start, the middle of the Seahorse valley.
+const double centerY = -0.129123012;  // Center point on the imaginary axis at the start
+const long ZOOM_FRAMES = 1024;        // The zoom grows by 1 every frame, up to this
+
+inline void initializeScreen(Framebuffer& screen)
+{
+  screen.clear();
+}
+
+
+/**
+ * Where a row of the screen is in the plane: the pixel x of the row is the point
+ * ((x - halfWidth) / spanX + centerX, y), and it gets the number of iterations
+ * (up to maxIterations) its orbit stays within the threshold for
+ **/
+struct MandelbrotRow
+{
+  double halfWidth;
+  double spanX;
+  double centerX;
+  double y;
+  double threshold;
+  int maxIterations;
+};
+
+/**
+ * Calculates the pixels [first, last) of a row
+ **/
+typedef void (*MandelbrotRowFunction)(uint8_t* row, int first, int last, const MandelbrotRow& where);
+
+inline void mandelbrotRowScalar(uint8_t* row, int first, int last, const MandelbrotRow& where)
+{
+    for (int x = first; x < last; x++) {
+        double zx = (static_cast<double>(x) - where.halfWidth) / where.spanX + where.centerX;
+        double zy = where.y;
+
+        double cx = zx;
+        double cy = zy;
+        double zx2 = zx * zx;
+        double zy2 = zy * zy;
+
+        int colour = 0;
+        while (zx2 + zy2 < where.threshold && colour < where.maxIterations) 
+        {
+
+            zy = 2.0 * zx * zy + cy;
+            zx = zx2 - zy2 + cx;
+
+            zx2 = zx * zx;
+            zy2 = zy * zy;
+
+
+            colour++;
+        }
+        
+        row[x] = static_cast<uint8_t>(colour);
+    }
+}
+
+#ifdef LXF_X86
+
+/**
+ * Iterates two points at a time. A point which has escaped (or run out of
+ * iterations) stops counting, and the pair goes on until both have: the
+ * operations are the ones of the scalar version, in the same order, so the
+ * points get exactly the same counts.
+ **/
+inline void mandelbrotRowSse2(uint8_t* row, int first, int last, const MandelbrotRow& where)
+{
+  const __m128d two = _mm_set1_pd(2.0);
+  const __m128d one = _mm_set1_pd(1.0);
+  const __m128d threshold = _mm_set1_pd(where.threshold);
+  const __m128d limit = _mm_set1_pd(where.maxIterations);
+
+  int x = first;
+  for (; x + 2 <= last; x += 2)
+  {
+    const __m128d cx = _mm_add_pd(_mm_div_pd(_mm_sub_pd(_mm_setr_pd(x, x + 1), _mm_set1_pd(where.halfWidth)), _mm_set1_pd(where.spanX)), _mm_set1_pd(where.centerX));
+    const __m128d cy = _mm_set1_pd(where.y);
+    __m128d zx = cx, zy = cy;
+    __m128d zx2 = _mm_mul_pd(zx, zx), zy2 = _mm_mul_pd(zy, zy);
+    __m128d count = _mm_setzero_pd();
+    __m128d active = _mm_and_pd(_mm_cmplt_pd(_mm_add_pd(zx2, zy2), threshold), _mm_cmplt_pd(count, limit));
+    while (_mm_movemask_pd(active))
+    {
+      zy = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(two, zx), zy), cy);
+      zx = _mm_add_pd(_mm_sub_pd(zx2, zy2), cx);
+      zx2 = _mm_mul_pd(zx, zx);
+      zy2 = _mm_mul_pd(zy, zy);
+      count = _mm_add_pd(count, _mm_and_pd(active, one));
+      active = _mm_and_pd(active, _mm_and_pd(_mm_cmplt_pd(_mm_add_pd(zx2, zy2), threshold), _mm_cmplt_pd(count, limit)));
+    }
+
+    alignas(16) int counts[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(counts), _mm_cvttpd_epi32(count));
+    row[x] = static_cast<uint8_t>(counts[0]);
+    row[x + 1] = static_cast<uint8_t>(counts[1]);
+  }
+  mandelbrotRowScalar(row, x, last, where);
+}
+
+// The same with four points at a time
+__attribute__((target("avx2")))
+inline void mandelbrotRowAvx2(uint8_t* row, int first, int last, const MandelbrotRow& where)
+{
+  const __m256d two = _mm256_set1_pd(2.0);
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d threshold = _mm256_set1_pd(where.threshold);
+  const __m256d limit = _mm256_set1_pd(where.maxIterations);
+
+  int x = first;
+  for (; x + 4 <= last; x += 4)
+  {
+    const __m256d cx = _mm256_add_pd(_mm256_div_pd(_mm256_sub_pd(_mm256_setr_pd(x, x + 1, x + 2, x + 3), _mm256_set1_pd(where.halfWidth)), _mm256_set1_pd(where.spanX)), _mm256_set1_pd(where.centerX));
+    const __m256d cy = _mm256_set1_pd(where.y);
+    __m256d zx = cx, zy = cy;
+    __m256d zx2 = _mm256_mul_pd(zx, zx), zy2 = _mm256_mul_pd(zy, zy);
+    __m256d count = _mm256_setzero_pd();
+    __m256d active = _mm256_and_pd(_mm256_cmp_pd(_mm256_add_pd(zx2, zy2), threshold, _CMP_LT_OQ), _mm256_cmp_pd(count, limit, _CMP_LT_OQ));
+    while (_mm256_movemask_pd(active))
+    {
+      zy = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(two, zx), zy), cy);
+      zx = _mm256_add_pd(_mm256_sub_pd(zx2, zy2), cx);
+      zx2 = _mm256_mul_pd(zx, zx);
+      zy2 = _mm256_mul_pd(zy, zy);
+      count = _mm256_add_pd(count, _mm256_and_pd(active, one));
+      active = _mm256_and_pd(active, _mm256_and_pd(_mm256_cmp_pd(_mm256_add_pd(zx2, zy2), threshold, _CMP_LT_OQ), _mm256_cmp_pd(count, limit, _CMP_LT_OQ)));
+    }
+
+    alignas(16) int counts[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(counts), _mm256_cvttpd_epi32(count));
+    for (int i = 0; i < 4; i++)
+    {
+      row[x + i] = static_cast<uint8_t>(counts[i]);
+    }
+  }
+  mandelbrotRowScalar(row, x, last, where);
+}
+
+/**
+ * The same with eight points at a time, the lanes still counting are kept in a
+ * mask register. AVX-512 comes with FMA, and a fused multiply-add rounds once
+ * instead of twice, which would change the counts of the points near the edge
+ * of the set: the compiler is not allowed to fuse them here.
+ **/
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline void mandelbrotRowAvx512(uint8_t* row, int first, int last, const MandelbrotRow& where)
+{
+  const __m512d two = _mm512_set1_pd(2.0);
+  const __m512d one = _mm512_set1_pd(1.0);
+  const __m512d threshold = _mm512_set1_pd(where.threshold);
+  const __m512d limit = _mm512_set1_pd(where.maxIterations);
+  const __m512d lanes = _mm512_setr_pd(0, 1, 2, 3, 4, 5, 6, 7);
+
+  int x = first;
+  for (; x + 8 <= last; x += 8)
+  {
+    const __m512d cx = _mm512_add_pd(_mm512_div_pd(_mm512_sub_pd(_mm512_add_pd(_mm512_set1_pd(x), lanes), _mm512_set1_pd(where.halfWidth)), _mm512_set1_pd(where.spanX)), _mm512_set1_pd(where.centerX));
+    const __m512d cy = _mm512_set1_pd(where.y);
+    __m512d zx = cx, zy = cy;
+    __m512d zx2 = _mm512_mul_pd(zx, zx), zy2 = _mm512_mul_pd(zy, zy);
+    __m512d count = _mm512_setzero_pd();
+    __mmask8 active = _mm512_cmp_pd_mask(_mm512_add_pd(zx2, zy2), threshold, _CMP_LT_OQ) & _mm512_cmp_pd_mask(count, limit, _CMP_LT_OQ);
+    while (active)
+    {
+      zy = _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(two, zx), zy), cy);
+      zx = _mm512_add_pd(_mm512_sub_pd(zx2, zy2), cx);
+      zx2 = _mm512_mul_pd(zx, zx);
+      zy2 = _mm512_mul_pd(zy, zy);
+      count = _mm512_mask_add_pd(count, active, count, one);
+      active &= _mm512_cmp_pd_mask(_mm512_add_pd(zx2, zy2), threshold, _CMP_LT_OQ) & _mm512_cmp_pd_mask(count, limit, _CMP_LT_OQ);
+    }
+
+    alignas(32) int counts[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(counts), _mm512_cvttpd_epi32(count));
+    for (int i = 0; i < 8; i++)
+    {
+      row[x + i] = static_cast<uint8_t>(counts[i]);
+    }
+  }
+  mandelbrotRowScalar(row, x, last, where);
+}
+
+#endif
+
+/**
+ * Picks the fastest row for the given tier, the one of the CPU by default
+ **/
+inline MandelbrotRowFunction selectMandelbrotRow(CpuTier tier = cpuTier())
+{
+#ifdef LXF_X86
+  if (tier >= CPU_AVX512) return mandelbrotRowAvx512;
+  if (tier >= CPU_AVX2) return mandelbrotRowAvx2;
+  if (tier >= CPU_SSE2) return mandelbrotRowSse2;
+#endif
+  return mandelbrotRowScalar;
+}
+
+/**
+ * Calculates the set on the whole screen. The size is a ScreenSize, so the common
+ * display sizes get their own instantiation.
+ **/
+template<class Size>
+inline void drawMandelbrot(Framebuffer& screen, Size size, double zoomFactor, double centerX, double centerY)
+{
+    const int width = size.width();
+    const int height = size.height();
+    static const MandelbrotRowFunction iterate = selectMandelbrotRow();
+
+    // Every point of the set is calculated on its own, the rows are done in parallel bands
+    parallelForRows(height, screen.stride(), [&](int firstRow, int lastRow) {
+    for (int y = firstRow; y < lastRow; y++) {
+        MandelbrotRow where;
+        where.halfWidth = width / 2;
+        where.spanX = zoomFactor * width;
+        where.centerX = centerX;
+        where.y = (static_cast<double>(y) - height / 2) / (zoomFactor * height) + centerY;
+        where.threshold = MANDELBROT_THRESHOLD;
+        where.maxIterations = MANDELBROT_MAX_ITERATIONS;
+        iterate(screen.row(y), 0, width, where);
+    }
+    });
+}
+
+inline void updateScreen(Framebuffer& screen, double zoomFactor, double centerX, double centerY) 
+{
+    withScreenSize(screen.width(), screen.height(), [&](auto size) {
+        drawMandelbrot(screen, size, zoomFactor, centerX, centerY);
+    });
+}
+
+
+/**
+ * Will generate the palette for the fractal. If you want to obtain the same colours as from the article,
+ * please use the colour cycle palette from episode 1.
+ **/
+inline void generatePalette(Colour* colours) 
+{
+    for (int i = 0; i < 256; ++i) 
+    {
+        uint8_t red = static_cast<uint8_t>((i * 2) % 256);
+        uint8_t green = static_cast<uint8_t>((i * 5) % 256);
+        uint8_t blue = static_cast<uint8_t>((i * 7) % 256);
+
+        colours[i] = { red, green, blue, 255 };
+    }
+    colours[255] = { 0, 0, 0, 255 };
+}
+
+/**
+ * Zooming into the Seahorse valley of the Mandelbrot set
+ **/
+class MandelzoomEffect : public Effect
+{
+public:
+  const char* title() const override { return "Mandel Zoomer"; }
+  int width() const override { return DEFAULT_SCREENSIZE_X; }
+  int height() const override { return DEFAULT_SCREENSIZE_Y; }
+
+  // Every frame is drawn at the size of the screen it is drawn on
+  bool resize(Framebuffer& screen) override
+  {
+    return true;
+  }
+
+  bool init(Framebuffer& screen) override
+  {
+    generatePalette(colours.data());
+    initializeScreen(screen);
+    frame = 0;
+    return true;
+  }
+
+  bool update(Framebuffer& screen) override
+  {
+    return drawFrame(screen, frame++);
+  }
+
+  bool drawFrame(Framebuffer& screen, long frame) const override
+  {
+    if(frame < 0 || frame >= ZOOM_FRAMES) 
+    {
+        return false;
+    }
+
+    // Experiments here, with various other values are welcome, such as to zoom in faster, more, move left/right in the fractal.
+    // With these values we zoom into a slightly rotated baby mandel, see for yourself what you can discover.
+    double zoom = static_cast<double>(frame);
+    updateScreen(screen, zoom, centerX - frame * 0.00000001, centerY - frame * 0.00001);
+    return true;
+  }
+
+  long frameCount() const override { return ZOOM_FRAMES; }
+
+  bool seek(long frame) override
+  {
+    if (frame < 0)
+    {
+      return false;
+    }
+    this->frame = frame;
+    return true;
+  }
+
+  bool saveState(StateWriter& state) const override
+  {
+    state.write(frame);
+    return true;
+  }
+
+  bool loadState(StateReader& state) override
+  {
+    return state.read(frame);
+  }
+
+private:
+  long frame = 0;             // The frame the next update draws
+};
+
+}
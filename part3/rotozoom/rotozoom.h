@@ -0,0 +1,272 @@
+#pragma once
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cpu_dispatch.h"
+#include "custom_image.h"
+#include "effect.h"
+#include "framebuffer.h"
+#include "screen_size.h"
+#include "thread_pool.h"
+
+namespace rotozoom {
+
+// The size of the screen the effect was written for
+const int DEFAULT_SCREENSIZE_X = 1920;
+const int DEFAULT_SCREENSIZE_Y = 1080;
+
+const int XMIN = 0;
+const int YMIN = 2;
+const int SPEED = 1;
+const int TEXTURE_SIZE_X = 200;
+const int TEXTURE_SIZE_Y = 200;
+
+inline void initializeScreen(Framebuffer& screen)
+{
+  screen.clear();
+}
+
+/**
+ * Where the texture is seen from: the pixel (x, y) of the screen shows the texel
+ * ((x * cos - y * sin) * zoom, (x * sin + y * cos) * zoom), wrapped around
+ **/
+struct RotozoomView
+{
+  const uint8_t* texture;
+  double sin_angle;
+  double cos_angle;
+  double zoom_factor;
+};
+
+/**
+ * Draws the pixels [first, last) of the row y of the screen
+ **/
+typedef void (*RotozoomSpanFunction)(uint8_t* row, int y, int first, int last, const RotozoomView& view);
+
+inline void rotozoomSpanScalar(uint8_t* row, int y, int first, int last, const RotozoomView& view)
+{
+    for (int x = first; x < last; x++) 
+    {
+        int u = static_cast<int>((x * view.cos_angle - y * view.sin_angle) * view.zoom_factor) % TEXTURE_SIZE_X;
+        int v = static_cast<int>((x * view.sin_angle + y * view.cos_angle) * view.zoom_factor) % TEXTURE_SIZE_Y;
+        while(u < 0)
+        {
+            u += TEXTURE_SIZE_X;
+        }
+
+        while(v < 0) 
+        {
+            v += TEXTURE_SIZE_Y;
+        }
+
+        row[x] = view.texture[ u * TEXTURE_SIZE_X + v];
+    }
+}
+
+#ifdef LXF_X86
+
+/**
+ * The texel coordinates of two pixels at a time. The remainders are taken in
+ * doubles (truncating the quotient, like the integer division does), which
+ * needs no integer divisions at all, and the index of the texel is written to
+ * offsets, as there is no gather of bytes.
+ **/
+inline void rotozoomOffsetsSse2(int x, int y, const RotozoomView& view, int* offsets)
+{
+  const __m128d xs = _mm_setr_pd(x, x + 1);
+  const __m128d sizeU = _mm_set1_pd(TEXTURE_SIZE_X);
+  const __m128d sizeV = _mm_set1_pd(TEXTURE_SIZE_Y);
+  const __m128d zero = _mm_setzero_pd();
+
+  __m128d u = _mm_mul_pd(_mm_sub_pd(_mm_mul_pd(xs, _mm_set1_pd(view.cos_angle)), _mm_set1_pd(y * view.sin_angle)), _mm_set1_pd(view.zoom_factor));
+  __m128d v = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(xs, _mm_set1_pd(view.sin_angle)), _mm_set1_pd(y * view.cos_angle)), _mm_set1_pd(view.zoom_factor));
+  u = _mm_cvtepi32_pd(_mm_cvttpd_epi32(u));
+  v = _mm_cvtepi32_pd(_mm_cvttpd_epi32(v));
+  u = _mm_sub_pd(u, _mm_mul_pd(_mm_cvtepi32_pd(_mm_cvttpd_epi32(_mm_div_pd(u, sizeU))), sizeU));
+  v = _mm_sub_pd(v, _mm_mul_pd(_mm_cvtepi32_pd(_mm_cvttpd_epi32(_mm_div_pd(v, sizeV))), sizeV));
+  u = _mm_add_pd(u, _mm_and_pd(_mm_cmplt_pd(u, zero), sizeU));
+  v = _mm_add_pd(v, _mm_and_pd(_mm_cmplt_pd(v, zero), sizeV));
+  _mm_storel_epi64(reinterpret_cast<__m128i*>(offsets), _mm_cvttpd_epi32(_mm_add_pd(_mm_mul_pd(u, sizeU), v)));
+}
+
+inline void rotozoomSpanSse2(uint8_t* row, int y, int first, int last, const RotozoomView& view)
+{
+  alignas(16) int offsets[2];
+  int x = first;
+  for (; x + 2 <= last; x += 2)
+  {
+    rotozoomOffsetsSse2(x, y, view, offsets);
+    row[x] = view.texture[offsets[0]];
+    row[x + 1] = view.texture[offsets[1]];
+  }
+  rotozoomSpanScalar(row, y, x, last, view);
+}
+
+// The same with four pixels at a time
+__attribute__((target("avx2")))
+inline void rotozoomSpanAvx2(uint8_t* row, int y, int first, int last, const RotozoomView& view)
+{
+  const __m256d sizeU = _mm256_set1_pd(TEXTURE_SIZE_X);
+  const __m256d sizeV = _mm256_set1_pd(TEXTURE_SIZE_Y);
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d cosAngle = _mm256_set1_pd(view.cos_angle);
+  const __m256d sinAngle = _mm256_set1_pd(view.sin_angle);
+  const __m256d zoom = _mm256_set1_pd(view.zoom_factor);
+  const __m256d ySin = _mm256_set1_pd(y * view.sin_angle);
+  const __m256d yCos = _mm256_set1_pd(y * view.cos_angle);
+
+  alignas(16) int offsets[4];
+  int x = first;
+  for (; x + 4 <= last; x += 4)
+  {
+    const __m256d xs = _mm256_setr_pd(x, x + 1, x + 2, x + 3);
+    __m256d u = _mm256_mul_pd(_mm256_sub_pd(_mm256_mul_pd(xs, cosAngle), ySin), zoom);
+    __m256d v = _mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(xs, sinAngle), yCos), zoom);
+    u = _mm256_cvtepi32_pd(_mm256_cvttpd_epi32(u));
+    v = _mm256_cvtepi32_pd(_mm256_cvttpd_epi32(v));
+    u = _mm256_sub_pd(u, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_cvttpd_epi32(_mm256_div_pd(u, sizeU))), sizeU));
+    v = _mm256_sub_pd(v, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_cvttpd_epi32(_mm256_div_pd(v, sizeV))), sizeV));
+    u = _mm256_add_pd(u, _mm256_and_pd(_mm256_cmp_pd(u, zero, _CMP_LT_OQ), sizeU));
+    v = _mm256_add_pd(v, _mm256_and_pd(_mm256_cmp_pd(v, zero, _CMP_LT_OQ), sizeV));
+    _mm_store_si128(reinterpret_cast<__m128i*>(offsets), _mm256_cvttpd_epi32(_mm256_add_pd(_mm256_mul_pd(u, sizeU), v)));
+
+    row[x] = view.texture[offsets[0]];
+    row[x + 1] = view.texture[offsets[1]];
+    row[x + 2] = view.texture[offsets[2]];
+    row[x + 3] = view.texture[offsets[3]];
+  }
+  rotozoomSpanScalar(row, y, x, last, view);
+}
+
+#endif
+
+/**
+ * Picks the fastest span for the given tier, the one of the CPU by default. There
+ * is no AVX-512 one, that tier gets the AVX2 span.
+ **/
+inline RotozoomSpanFunction selectRotozoomSpan(CpuTier tier = cpuTier())
+{
+#ifdef LXF_X86
+  if (tier >= CPU_AVX2) return rotozoomSpanAvx2;
+  if (tier >= CPU_SSE2) return rotozoomSpanSse2;
+#endif
+  return rotozoomSpanScalar;
+}
+
+/**
+ * Draws the rotated and zoomed texture on the whole screen. The size is a
+ * ScreenSize, so the common display sizes get their own instantiation.
+ **/
+template<class Size>
+inline void drawRotozoom(Framebuffer& screen, const uint8_t* texture, Size size, double sin_angle, double cos_angle, double zoom_factor)
+{
+    const int width = size.width();
+    const RotozoomView view = {texture, sin_angle, cos_angle, zoom_factor};
+    static const RotozoomSpanFunction span = selectRotozoomSpan();
+
+    // The rows are independent of each other, they are done in parallel bands
+    parallelForRows(size.height(), screen.stride(), [&](int firstRow, int lastRow) {
+    for (int y = firstRow; y < lastRow; y++) 
+    {
+        span(screen.row(y), y, 0, width, view);
+    }
+    });
+}
+
+/**
+ * Draws the given frame, the texture turns by SPEED degrees every frame
+ **/
+inline void updateScreen(Framebuffer& screen, const uint8_t* texture, long frame) 
+{
+    int angle = static_cast<int>((frame + 1) * SPEED % 360);
+
+    auto rad_angle = angle * M_PI / 180.0;
+    auto sin_angle = sin(rad_angle);
+    auto cos_angle = cos(rad_angle);
+    auto zoom_factor = cos_angle * 1.1;
+
+    withScreenSize(screen.width(), screen.height(), [&](auto size) {
+        drawRotozoom(screen, texture, size, sin_angle, cos_angle, zoom_factor);
+    });
+}
+
+/**
+ * A rotating and zooming texture
+ **/
+class RotozoomEffect : public Effect
+{
+public:
+  explicit RotozoomEffect(const std::string& assetPath = "output_image.custom") : assetPath(assetPath) {}
+
+  const char* title() const override { return "Rotozoom"; }
+  int width() const override { return DEFAULT_SCREENSIZE_X; }
+  int height() const override { return DEFAULT_SCREENSIZE_Y; }
+  double updateRate() const override { return 50; }
+
+  // Every frame is drawn at the size of the screen it is drawn on
+  bool resize(Framebuffer& screen) override
+  {
+    return true;
+  }
+
+  bool init(Framebuffer& screen) override
+  {
+    initializeScreen(screen);
+    frame = 0;
+
+    if (!loadCustomImage(assetPath, texture)) {
+        return false;
+    }
+    if (!texture.covers(TEXTURE_SIZE_X, TEXTURE_SIZE_Y)) {
+        std::cerr << "The texture has to be " << TEXTURE_SIZE_X << "x" << TEXTURE_SIZE_Y << ": " << assetPath << std::endl;
+        return false;
+    }
+
+    texture.applyPalette(colours);
+    return true;
+  }
+
+  bool update(Framebuffer& screen) override
+  {
+    return drawFrame(screen, frame++);
+  }
+
+  bool drawFrame(Framebuffer& screen, long frame) const override
+  {
+    updateScreen(screen, texture.pixels(), frame);
+    return true;
+  }
+
+  bool seek(long frame) override
+  {
+    if (frame < 0)
+    {
+      return false;
+    }
+    this->frame = frame;
+    return true;
+  }
+
+  bool saveState(StateWriter& state) const override
+  {
+    state.write(frame);
+    return true;
+  }
+
+  bool loadState(StateReader& state) override
+  {
+    return state.read(frame);
+  }
+
+private:
+  std::string assetPath;
+  CustomImage texture;
+  long frame = 0;             // The frame the next update draws
+};
+
+}
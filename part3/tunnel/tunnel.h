@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "custom_image.h"
+#include "effect.h"
+#include "framebuffer.h"
+#include "screen_size.h"
+#include "thread_pool.h"
+
+namespace tunnel {
+
+// The size of the screen the effect was written for
+const int DEFAULT_SCREENSIZE_X = 1024;
+const int DEFAULT_SCREENSIZE_Y = 768;
+
+const int XMIN = 0;
+const int YMIN = 2;
+const int SPEED = 1;
+const int TEXTURE_SIZE = 256;
+const int TUNNEL_END_SIZE = 100;
+
+inline void initializeScreen(Framebuffer& screen) {
+  screen.clear();
+}
+
+inline bool isPointInsideCircle(int pointX, int pointY, int circleCenterX,
+                         int circleCenterY, int circleRadius) {
+  // Calculate the distance between the point and the center of the circle
+  int distance =
+      sqrt(pow(pointX - circleCenterX, 2) + pow(pointY - circleCenterY, 2));
+
+  // Check if the distance is less than the radius of the circle
+  return distance < circleRadius;
+}
+
+/**
+ * Draws the tunnel on the whole screen. The size is a ScreenSize, so the common
+ * display sizes get their own instantiation.
+ **/
+template<class Size>
+inline void drawTunnel(Framebuffer& screen, const uint8_t* texture, Size size, double rotation, double zoom) {
+  static const int DISTORTION = 64;
+  static const double MULTIPLICATOR = 2.5;
+
+  const int width = size.width();
+  const int TUNNEL_CENTRE_X = width / 2;
+  const int TUNNEL_CENTRE_Y = size.height() / 2;
+
+  // Every pixel depends only on its coordinates, so the rows are done in parallel bands
+  parallelForRows(size.height(), screen.stride(), [&](int firstRow, int lastRow) {
+  for (int y = firstRow; y < lastRow; y++) {
+    uint8_t* row = screen.row(y);
+    for (int x = 0; x < width; x++) {
+      if (!isPointInsideCircle(x, y, TUNNEL_CENTRE_X, TUNNEL_CENTRE_Y, TUNNEL_END_SIZE))
+      {
+        int distance = static_cast<int>(DISTORTION * TEXTURE_SIZE / log(pow(x - TUNNEL_CENTRE_X, 2) + pow(y - TUNNEL_CENTRE_Y, 2)) );
+        int angle = static_cast<int>(MULTIPLICATOR * TEXTURE_SIZE * atan2(x - TUNNEL_CENTRE_X, y - TUNNEL_CENTRE_Y) / M_PI );
+
+        unsigned u = static_cast<unsigned>(distance + TEXTURE_SIZE * zoom) % TEXTURE_SIZE;
+        unsigned v = static_cast<unsigned>(angle    + TEXTURE_SIZE * rotation) % TEXTURE_SIZE;
+
+        row[x] = texture[u * TEXTURE_SIZE + v];
+      } 
+      else 
+      {
+        row[x] = 0;
+      }
+    }
+  }
+  });
+}
+
+/**
+ * Draws the given frame, the texture turns and comes closer by 0.01 every frame
+ **/
+inline void updateScreen(Framebuffer& screen, const uint8_t* texture, long frame) {
+  double animation_rotation = (frame + 1) * 0.01;
+  double animation_zoom = (frame + 1) * 0.01;
+
+  withScreenSize(screen.width(), screen.height(), [&](auto size) {
+    drawTunnel(screen, texture, size, animation_rotation, animation_zoom);
+  });
+}
+
+/**
+ * Flying through a textured tunnel
+ **/
+class TunnelEffect : public Effect
+{
+public:
+  explicit TunnelEffect(const std::string& assetPath = "output_image.custom") : assetPath(assetPath) {}
+
+  const char* title() const override { return "Tunnel"; }
+  int width() const override { return DEFAULT_SCREENSIZE_X; }
+  int height() const override { return DEFAULT_SCREENSIZE_Y; }
+  double updateRate() const override { return 100; }
+
+  // Every frame is drawn at the size of the screen it is drawn on
+  bool resize(Framebuffer& screen) override
+  {
+    return true;
+  }
+
+  bool init(Framebuffer& screen) override
+  {
+    initializeScreen(screen);
+    frame = 0;
+
+    if (!loadCustomImage(assetPath, texture)) {
+      return false;
+    }
+    if (!texture.covers(TEXTURE_SIZE, TEXTURE_SIZE)) {
+      std::cerr << "The texture has to be " << TEXTURE_SIZE << "x" << TEXTURE_SIZE << ": " << assetPath << std::endl;
+      return false;
+    }
+
+    texture.applyPalette(colours);
+    return true;
+  }
+
+  bool update(Framebuffer& screen) override
+  {
+    return drawFrame(screen, frame++);
+  }
+
+  bool drawFrame(Framebuffer& screen, long frame) const override
+  {
+    updateScreen(screen, texture.pixels(), frame);
+    return true;
+  }
+
+  bool seek(long frame) override
+  {
+    if (frame < 0)
+    {
+      return false;
+    }
+    this->frame = frame;
+    return true;
+  }
+
+  bool saveState(StateWriter& state) const override
+  {
+    state.write(frame);
+    return true;
+  }
+
+  bool loadState(StateReader& state) override
+  {
+    return state.read(frame);
+  }
+
+private:
+  std::string assetPath;
+  CustomImage texture;
+  long frame = 0;             // The frame the next update draws
+};
+
+}
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "arena.h"
+#include "custom_image.h"
+#include "effect.h"
+#include "framebuffer.h"
+#include "random.h"
+#include "ripple.h"
+#include "screen_size.h"
+#include "thread_pool.h"
+
+namespace rain {
+
+// The size of the screen the effect was written for
+const int DEFAULT_SCREENSIZE_X = 800;
+const int DEFAULT_SCREENSIZE_Y = 600;
+
+const int XMIN = 0;
+const int YMIN = 2;
+
+const int RIPPLE_DENSITY = 16;
+const float RIPPLE_HEIGHT = 14.0;
+const bool LIGHT = true;
+const int WATER_WOBBLITY = 8;
+
+/**
+ * The water moves: every row of the new page is calculated from the old page by
+ * the ripple kernel of the CPU
+ **/
+inline void calculateWater(const ArenaArray<int>* heightMap, int width, int height, int npage, int density)
+{
+  int* newptr = &heightMap[npage][0];
+  int* oldptr = &heightMap[npage ^ 1][0];
+  static const RippleKernels kernels = selectRippleKernels();
+
+  // Every cell depends only on the old page and on itself, the rows are done in parallel bands
+  parallelForRows(height, static_cast<int>(width * sizeof(int)), [&](int firstRow, int lastRow) {
+    for (int y = std::max(firstRow, 1); y < std::min(lastRow, height - 1); y++)
+    {
+      kernels.ripple(newptr + y * width, oldptr + y * width, width, density);
+    }
+  });
+}
+
+inline void smoothenWater(const ArenaArray<int>* heightMap, int width, int height, int npage)
+{
+  int* newptr = &heightMap[npage][0];
+  int* oldptr = &heightMap[npage ^ 1][0];
+  static const RippleKernels kernels = selectRippleKernels();
+
+  parallelForRows(height, static_cast<int>(width * sizeof(int)), [&](int firstRow, int lastRow) {
+    for (int y = std::max(firstRow, 1); y < std::min(lastRow, height - 1); y++) {
+      kernels.smooth(newptr + y * width, oldptr + y * width, width, 0);
+    }
+  });
+}
+
+// The kernel takes the size as a ScreenSize, so the common display sizes get their own instantiation
+template<class Size>
+inline void drawWater(const ArenaArray<int>* heightMap, int page, const uint8_t* image, Framebuffer& screen, Size size)
+{
+  const int width = size.width();
+  const int height = size.height();
+  int* ptr = &heightMap[page][0];
+
+  // The screen is written only where the height map is read, the rows are done in parallel bands
+  parallelForRows(height, screen.stride(), [&](int firstRow, int lastRow) {
+    for (int y = std::max(firstRow, 1); y < std::min(lastRow, height - 1); y++)
+    {
+      uint8_t* row = screen.row(y);
+      int offset = y * width;
+      for (int x = 0; x < width - 2; x++)
+      {
+        unsigned dx = ptr[offset] - ptr[offset - 1];
+        unsigned dy = ptr[offset] - ptr[offset + width];
+        size_t idx = (offset + (LIGHT ? 2 : 1) * width * dx + dy) % (width * height);
+        int c = image[idx];
+        row[x] = (c < 0) ? 0 : (c > 254) ? 254 + (LIGHT ? 1 : 0) : c;
+        offset++;
+      }
+    }
+  });
+}
+
+inline void drawWater(const ArenaArray<int>* heightMap, int width, int height, int page, const uint8_t* image, Framebuffer& screen)
+{
+  withScreenSize(width, height, [&](auto size) { drawWater(heightMap, page, image, screen, size); });
+}
+
+inline void waterDroplet(const ArenaArray<int>* heightMap, int width, int height, int x, int y, int radius, int strength, int page) 
+{
+  int radsquare = pow(radius, 2) / 6;
+  float length = RIPPLE_HEIGHT / pow(radius, 2);
+
+  strength *= pow(RIPPLE_HEIGHT, 3);
+
+  int left = -radius;
+  int right = radius;
+  int top = -radius;
+  int bottom = radius;
+
+  if (x - radius < 1) left -= (x - radius - 1);
+  if (y - radius < 1) top -= (y - radius - 1);
+  if (x + radius > width - 1) right -= (x + radius - width + 1);
+  if (y + radius > height - 1) bottom -= (y + radius - height + 1);
+
+  for (int cy = top; cy < bottom; cy++) {
+    for (int cx = left; cx < right; cx++) {
+      int square = (cy * cy) + (cx * cx)/6;
+      if (square < radsquare) {
+        int dist = sqrt(sin(square * length) + sin(square * length));
+        heightMap[page][width * (cy + y) + cx + x] += (int)(((dist) * RIPPLE_DENSITY) * (strength)) / ( pow(RIPPLE_HEIGHT, 4));
+      }
+    }
+  }
+}
+
+inline void initializeScreen(Framebuffer& screen) {
+  screen.clear();
+}
+
+struct Droplet
+{
+  int x, y;
+  int rippleCount;
+  int radius;
+  int maxRadius;
+
+  int ctr; 
+};
+
+/**
+ * Every droplet makes ripples for a while, then falls again somewhere else. The
+ * random bits of a droplet only depend on the seed, the frame and the number of
+ * the droplet, like the ones of the fires.
+ **/
+inline void updateScreen(Framebuffer& screen, const ArenaArray<int>* heightMap, int width, int height, const uint8_t* image, std::vector<Droplet>& droplets, int& currentHeightMapIndex,
+                         const CounterRandom& random, uint32_t frame) 
+{
+  for (int i = 0; i < droplets.size(); i++) 
+  {
+    droplets[i].ctr++;
+
+    calculateWater(heightMap, width, height, currentHeightMapIndex ^ 1, WATER_WOBBLITY);
+
+    for (int cc = 0; cc < droplets[i].ctr; cc++) {
+      waterDroplet(heightMap, width, height, droplets[i].x, droplets[i].y, cc * droplets[i].radius, droplets[i].radius, currentHeightMapIndex);
+      droplets[i].radius +=2;
+    }
+
+    smoothenWater(heightMap, width, height, currentHeightMapIndex);
+
+    if (droplets[i].ctr >= droplets[i].rippleCount) {
+      RandomBits where = random(frame, i, 0);
+      droplets[i].ctr = 0;
+      droplets[i].x = where.word[0] % width;
+      droplets[i].y = where.word[1] % height;
+      droplets[i].radius = 1;
+    }
+   
+  }
+  drawWater(heightMap, width, height, currentHeightMapIndex, image, screen);
+
+  currentHeightMapIndex ^= 1;
+}
+
+
+/**
+ * Rain drops falling on a fish pond
+ **/
+class RainEffect : public Effect
+{
+public:
+  explicit RainEffect(const std::string& assetPath = "output_image.custom") : assetPath(assetPath) {}
+
+  const char* title() const override { return "Fish in rain"; }
+  int width() const override { return DEFAULT_SCREENSIZE_X; }
+  int height() const override { return DEFAULT_SCREENSIZE_Y; }
+  double updateRate() const override { return 10; }
+
+  bool resize(Framebuffer& screen) override
+  {
+    // The two height maps, one int per pixel each, and the scaled image
+    size_t pixels = static_cast<size_t>(screen.width()) * screen.height();
+    arena.reset();
+    arena.reserve(2 * (pixels * sizeof(int) + Arena::ALIGNMENT) + pixels + Arena::ALIGNMENT);
+    scaled = ArenaArray<uint8_t>();
+    screenWidth = screen.width();
+    screenHeight = screen.height();
+
+    // The water becomes still
+    heightMap[0] = arena.allocate<int>(pixels, 0);
+    heightMap[1] = arena.allocate<int>(pixels, 0);
+
+    // The drops keep falling where they were, as far as they are still on the screen
+    for (Droplet& droplet : droplets) {
+        droplet.x %= screenWidth;
+        droplet.y %= screenHeight;
+    }
+    if (image.size() > 0) {
+        fitImage();
+    }
+    return true;
+  }
+
+  bool init(Framebuffer& screen) override
+  {
+    droplets.clear();
+    int dropletCount = rand() % 15 + 15;
+    for(int i=0; i< dropletCount; i++) 
+    {
+        droplets.push_back( {rand() % screenWidth, rand() % screenHeight / 2, rand() % 5 + 5, rand() % 25, rand() % 15 + 5, 1});
+    }
+
+    // Seeded from rand(), so the same seed gives the same rain
+    random.reseed(static_cast<uint64_t>(rand()) << 32 | static_cast<uint32_t>(rand()));
+    frame = 0;
+    currentHeightMapIndex = 0;
+
+    initializeScreen(screen);
+
+    if (!loadCustomImage(assetPath, image)) {
+        return false;
+    }
+    if (image.size() == 0) {
+        std::cerr << "The image is empty: " << assetPath << std::endl;
+        return false;
+    }
+
+    image.applyPalette(colours, 255);
+    fitImage();
+    return true;
+  }
+
+  bool update(Framebuffer& screen) override
+  {
+    updateScreen(screen, heightMap, screenWidth, screenHeight, background, droplets, currentHeightMapIndex, random, frame++);
+    return true;
+  }
+
+  /**
+   * The water is in the two pages of the height map of the effect, the pond
+   * below it never changes. The pages are only read back into an effect of the
+   * same size, where the droplets can fall.
+   **/
+  bool saveState(StateWriter& state) const override
+  {
+    state.write(screenWidth);
+    state.write(screenHeight);
+    state.write(droplets);
+    state.write(currentHeightMapIndex);
+    state.write(random.seed());
+    state.write(frame);
+    state.write(heightMap[0].data(), heightMap[0].size());
+    state.write(heightMap[1].data(), heightMap[1].size());
+    return true;
+  }
+
+  bool loadState(StateReader& state) override
+  {
+    int width = 0, height = 0;
+    if (!state.read(width) || !state.read(height) || width != screenWidth || height != screenHeight)
+    {
+      return false;
+    }
+
+    uint64_t seed;
+    if (!state.read(droplets) || !state.read(currentHeightMapIndex) || !state.read(seed) || !state.read(frame))
+    {
+      return false;
+    }
+    random.reseed(seed);
+    return state.read(heightMap[0].data(), heightMap[0].size()) &&
+           state.read(heightMap[1].data(), heightMap[1].size());
+  }
+
+private:
+  /**
+   * The pond is seen through the water pixel by pixel, so the image has to have
+   * the size of the screen. If it does not, a scaled copy is made.
+   **/
+  void fitImage()
+  {
+    if (image.width() == static_cast<unsigned>(screenWidth) && image.height() == static_cast<unsigned>(screenHeight)) {
+        background = image.pixels();
+        return;
+    }
+
+    if (scaled.size() != static_cast<size_t>(screenWidth) * screenHeight) {
+        scaled = arena.allocate<uint8_t>(static_cast<size_t>(screenWidth) * screenHeight);
+    }
+    for (int y = 0; y < screenHeight; y++) {
+        const uint8_t* row = image.pixels() + static_cast<size_t>(y) * image.height() / screenHeight * image.width();
+        for (int x = 0; x < screenWidth; x++) {
+            scaled[static_cast<size_t>(y) * screenWidth + x] = row[static_cast<size_t>(x) * image.width() / screenWidth];
+        }
+    }
+    background = scaled.data();
+  }
+
+  std::string assetPath;
+  CustomImage image;
+  int screenWidth = DEFAULT_SCREENSIZE_X;     // The size of the screen the effect draws on, set by resize()
+  int screenHeight = DEFAULT_SCREENSIZE_Y;
+  ArenaArray<int> heightMap[2];               // The two pages of the height of the water, one int per pixel of the screen
+  ArenaArray<uint8_t> scaled;
+  const uint8_t* background = nullptr;
+  std::vector<Droplet> droplets;
+  int currentHeightMapIndex = 0;              // The page of the height map drawn next
+  CounterRandom random;                       // Where the droplets fall again
+  uint32_t frame = 0;                         // The number of the frame being calculated
+};
+
+}
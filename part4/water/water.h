@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "arena.h"
+#include "effect.h"
+#include "framebuffer.h"
+#include "ripple.h"
+#include "screen_size.h"
+#include "thread_pool.h"
+
+namespace water {
+
+// The size of the screen the effect was written for
+const int DEFAULT_SCREENSIZE_X = 800;
+const int DEFAULT_SCREENSIZE_Y = 600;
+
+const int XMIN = 0;
+const int YMIN = 2;
+
+const int RIPPLE_DENSITY = 128;
+const float RIPPLE_HEIGHT = 2.0;
+const bool LIGHT = false;
+const int WATER_WOBBLITY = 8;
+
+/**
+ * The water moves: every row of the new page is calculated from the old page by
+ * the ripple kernel of the CPU
+ **/
+inline void calculateWater(const ArenaArray<int>* heightMap, int width, int height, int currentPage, int density)
+{
+  int* newptr = &heightMap[currentPage][0];
+  int* oldptr = &heightMap[currentPage ^ 1][0];
+  static const RippleKernels kernels = selectRippleKernels();
+
+  // Every cell depends only on the old page and on itself, the rows are done in parallel bands
+  parallelForRows(height, static_cast<int>(width * sizeof(int)), [&](int firstRow, int lastRow) {
+    for (int y = std::max(firstRow, 1); y < std::min(lastRow, height - 1); y++)
+    {
+      kernels.ripple(newptr + y * width, oldptr + y * width, width, density);
+    }
+  });
+}
+
+inline void smoothenWater(const ArenaArray<int>* heightMap, int width, int height, int currentPage)
+{
+  int* newptr = &heightMap[currentPage][0];
+  int* oldptr = &heightMap[currentPage ^ 1][0];
+  static const RippleKernels kernels = selectRippleKernels();
+
+  parallelForRows(height, static_cast<int>(width * sizeof(int)), [&](int firstRow, int lastRow) {
+    for (int y = std::max(firstRow, 1); y < std::min(lastRow, height - 1); y++) {
+      kernels.smooth(newptr + y * width, oldptr + y * width, width, 0);
+    }
+  });
+}
+
+// The kernel takes the size as a ScreenSize, so the common display sizes get their own instantiation
+template<class Size>
+inline void drawWater(const ArenaArray<int>* heightMap, int page, const int* imageData, Framebuffer& screen, Size size)
+{
+  const int width = size.width();
+  const int height = size.height();
+  int* ptr = &heightMap[page][0];
+
+  // The screen is written only where the height map is read, the rows are done in parallel bands
+  parallelForRows(height, screen.stride(), [&](int firstRow, int lastRow) {
+    for (int y = std::max(firstRow, 1); y < std::min(lastRow, height - 1); y++)
+    {
+      uint8_t* row = screen.row(y);
+      int offset = y * width;
+      for (int x = 0; x < width - 2; x++)
+      {
+        int dx = ptr[offset] - ptr[offset - 1];
+        int dy = ptr[offset] - ptr[offset + width];
+        int idx = (offset + (LIGHT ? 2 : 1) * width * dx + dy) % (width * height);
+        if (idx < 0) idx += width * height;   // the displacement can point above the screen, wrap it around
+        int c = imageData[idx];
+        row[x] = (c < 0) ? 0 : (c > 254) ? 254 + (LIGHT ? 1 : 0) : c;
+        offset++;
+      }
+    }
+  });
+}
+
+inline void drawWater(const ArenaArray<int>* heightMap, int width, int height, int page, const int* imageData, Framebuffer& screen)
+{
+  withScreenSize(width, height, [&](auto size) { drawWater(heightMap, page, imageData, screen, size); });
+}
+
+inline void waterDroplet(const ArenaArray<int>* heightMap, int width, int height, int x, int y, int radius, int strength, int page) 
+{
+  int radsquare = pow(radius, 2);
+  float length = RIPPLE_HEIGHT / pow(radius, 2);
+
+  strength *= pow(RIPPLE_HEIGHT, 3);
+
+  int left = -radius;
+  int right = radius;
+  int top = -radius;
+  int bottom = radius;
+
+  if (x - radius < 1) left -= (x - radius - 1);
+  if (y - radius < 1) top -= (y - radius - 1);
+  if (x + radius > width - 1) right -= (x + radius - width + 1);
+  if (y + radius > height - 1) bottom -= (y + radius - height + 1);
+
+  for (int cy = top; cy < bottom; cy++) {
+    for (int cx = left; cx < right; cx++) {
+      int square = cy * cy + cx * cx;
+      if (square < radsquare) {
+        int dist = sqrt(square * length + square * length);
+        heightMap[page][width * (cy + y) + cx + x] += (int)(((dist) * RIPPLE_DENSITY) * (strength)) / ( pow(RIPPLE_HEIGHT, 2));
+      }
+    }
+  }
+}
+
+inline void initializeScreen(Framebuffer& screen) {
+  screen.clear();
+}
+
+/**
+ * Where the ripples are: the droplets falling on the middle of the pool, which
+ * grow for 15 frames and start again, and the page of the height map drawn
+ **/
+struct Ripples
+{
+  int dropletRadius = 5;
+  int currentHeightMapIndex = 0;
+  int dropletCounter = 0;
+};
+
+inline void updateScreen(Framebuffer& screen, const ArenaArray<int>* heightMap, int width, int height, const int* imageData, Ripples& ripples) 
+{
+  int& dropletRadius = ripples.dropletRadius;
+  int& currentHeightMapIndex = ripples.currentHeightMapIndex;
+  int& dropletCounter = ripples.dropletCounter;
+
+  dropletCounter++;
+  
+  calculateWater(heightMap, width, height, currentHeightMapIndex ^ 1, WATER_WOBBLITY);
+
+  for (int cc = 0; cc < dropletCounter; cc++) 
+  {
+    waterDroplet(heightMap, width, height, width / 2, height / 2, cc * dropletRadius, dropletRadius * 10, currentHeightMapIndex);
+    smoothenWater(heightMap, width, height, currentHeightMapIndex);
+    dropletRadius+=4;
+  }
+
+  if (dropletCounter == 15) { 
+    dropletRadius = 0;
+    dropletCounter = 0;
+  }
+
+  drawWater(heightMap, width, height, currentHeightMapIndex, imageData, screen);
+
+  currentHeightMapIndex ^= 1;
+}
+
+/**
+ * Generates the picture seen through the water: a smooth blue gradient
+ **/
+inline void generateImage(int* imageData, int width, int height)
+{
+  for (int x = 0; x < width; x++)
+    for (int y = 0; y < height; y++)
+      imageData[y * width + x] = (int)( sin ((float)x / height)  * cos( (float)y / height) * 255);
+}
+
+/**
+ * Ripples spreading from the middle of a pool
+ **/
+class WaterEffect : public Effect
+{
+public:
+  const char* title() const override { return "Water ripples"; }
+  int width() const override { return DEFAULT_SCREENSIZE_X; }
+  int height() const override { return DEFAULT_SCREENSIZE_Y; }
+  double updateRate() const override { return 10; }
+
+  bool resize(Framebuffer& screen) override
+  {
+    // The two height maps and the image, one int per pixel each
+    size_t pixels = static_cast<size_t>(screen.width()) * screen.height();
+    arena.reset();
+    arena.reserve(3 * (pixels * sizeof(int) + Arena::ALIGNMENT));
+    screenWidth = screen.width();
+    screenHeight = screen.height();
+
+    // The water becomes still
+    heightMap[0] = arena.allocate<int>(pixels, 0);
+    heightMap[1] = arena.allocate<int>(pixels, 0);
+    imageData = arena.allocate<int>(pixels);
+    generateImage(imageData.data(), screenWidth, screenHeight);
+    return true;
+  }
+
+  bool init(Framebuffer& screen) override
+  {
+    initializeScreen(screen);
+
+    for (size_t i = 0; i < 255 * 4; i += 4) {
+      colours[i / 4].r = 0;
+      colours[i / 4].g = 0;
+      colours[i / 4].b = i/2;
+      colours[i / 4].a = 255;
+    }
+
+    colours[255] = {255,255,255,255};
+    ripples = Ripples();
+    return true;
+  }
+
+  bool update(Framebuffer& screen) override
+  {
+    updateScreen(screen, heightMap, screenWidth, screenHeight, imageData.data(), ripples);
+    return true;
+  }
+
+  /**
+   * The water is in the two pages of the height map of the effect, the picture
+   * below it never changes. The pages are only read back into an effect of the
+   * same size.
+   **/
+  bool saveState(StateWriter& state) const override
+  {
+    state.write(screenWidth);
+    state.write(screenHeight);
+    state.write(ripples);
+    state.write(heightMap[0].data(), heightMap[0].size());
+    state.write(heightMap[1].data(), heightMap[1].size());
+    return true;
+  }
+
+  bool loadState(StateReader& state) override
+  {
+    int width = 0, height = 0;
+    if (!state.read(width) || !state.read(height) || width != screenWidth || height != screenHeight)
+    {
+      return false;
+    }
+    return state.read(ripples) &&
+           state.read(heightMap[0].data(), heightMap[0].size()) &&
+           state.read(heightMap[1].data(), heightMap[1].size());
+  }
+
+private:
+  int screenWidth = DEFAULT_SCREENSIZE_X;     // The size of the screen the effect draws on, set by resize()
+  int screenHeight = DEFAULT_SCREENSIZE_Y;
+  ArenaArray<int> heightMap[2];               // The two pages of the height of the water, one int per pixel of the screen
+  ArenaArray<int> imageData;
+  Ripples ripples;
+};
+
+}
@@ -0,0 +1,572 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "all_effects.h"
+#include "compositor.h"
+#include "cpu_dispatch.h"
+#include "effect_seeker.h"
+#include "framebuffer.h"
+#include "host.h"
+#include "presenter.h"
+
+// The frames are summarized in a grid of this many blocks in both directions
+const int SIGNATURE_BLOCKS = 8;
+
+/**
+ * The allocations made with operator new since the start, so that --allocations
+ * can tell that the frames of the effects allocate nothing
+ **/
+std::atomic<long> allocationCount{0};
+
+void* operator new(size_t size)
+{
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  if (void* block = malloc(size ? size : 1))
+  {
+    return block;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* block) noexcept
+{
+  free(block);
+}
+
+void operator delete(void* block, size_t) noexcept
+{
+  free(block);
+}
+
+/**
+ * The settings of a test run
+ **/
+struct GoldenOptions
+{
+  long frames = 30;                   // The number of frames compared per effect
+  unsigned seed = 1;                  // The seed of the random number generator
+  std::string root = "..";            // The top directory of the repository, for the assets
+  std::string dir = "goldens";        // The directory of the golden files
+  int tolerance = -1;                 // Accept frames differing by at most this much per block, exact if negative
+  bool update = false;                // Write the golden files instead of comparing with them
+  bool pipeline = false;              // Run the effects on the pipelined main loop
+  bool seek = false;                  // Seek back and forth in the frames of the effects, see testSeeking()
+  bool allocations = false;           // Count the allocations of the frames instead, see testAllocations()
+  int threads = 0;                    // Threads calculating the effects, 0 uses all the cores
+  bool tier = false;                  // Only print the tier the kernels are picked for, see cpuTier()
+  std::vector<std::string> effects;   // The effects to test, all of them if empty
+};
+
+/**
+ * What we keep of a frame: the hashes of the indexed screen and of the palette,
+ * and the mean brightness of every block of the frame, for the comparisons with
+ * a tolerance
+ **/
+struct FrameSignature
+{
+  uint64_t screenHash = 0;
+  uint64_t paletteHash = 0;
+  std::vector<uint8_t> blocks;
+};
+
+// Hashes size bytes, going on from the hash of the bytes before them
+inline uint64_t fnv1a(const uint8_t* data, size_t size, uint64_t hash = 1469598103934665603ull)
+{
+  for (size_t i = 0; i < size; i++)
+  {
+    hash ^= data[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+inline FrameSignature signFrame(const Framebuffer& screen, const Palette& palette)
+{
+  FrameSignature signature;
+  // The rows are hashed one after the other, as if the screen had no guard bands
+  signature.screenHash = fnv1a(nullptr, 0);
+  for (int y = 0; y < screen.height(); y++)
+  {
+    signature.screenHash = fnv1a(screen.row(y), screen.width(), signature.screenHash);
+  }
+  signature.paletteHash = fnv1a(reinterpret_cast<const uint8_t*>(palette.data()), palette.size() * sizeof(Colour));
+
+  uint8_t luma[256];
+  for (int i = 0; i < 256; i++)
+  {
+    luma[i] = static_cast<uint8_t>((77 * palette[i].r + 150 * palette[i].g + 29 * palette[i].b) >> 8);
+  }
+
+  for (int by = 0; by < SIGNATURE_BLOCKS; by++)
+  {
+    for (int bx = 0; bx < SIGNATURE_BLOCKS; bx++)
+    {
+      int x0 = bx * screen.width() / SIGNATURE_BLOCKS, x1 = (bx + 1) * screen.width() / SIGNATURE_BLOCKS;
+      int y0 = by * screen.height() / SIGNATURE_BLOCKS, y1 = (by + 1) * screen.height() / SIGNATURE_BLOCKS;
+      uint64_t total = 0;
+      for (int y = y0; y < y1; y++)
+      {
+        const uint8_t* row = screen.row(y);
+        for (int x = x0; x < x1; x++)
+        {
+          total += luma[row[x]];
+        }
+      }
+      long count = static_cast<long>(x1 - x0) * (y1 - y0);
+      signature.blocks.push_back(static_cast<uint8_t>(count > 0 ? (total + count / 2) / count : 0));
+    }
+  }
+  return signature;
+}
+
+/**
+ * The signature of a frame with layers: the hash of its composited ARGB pixels
+ * instead of the indexed screen, and the mean brightness of its blocks
+ **/
+inline FrameSignature signComposited(const std::vector<uint32_t>& pixels, int width, int height, const Palette& palette)
+{
+  FrameSignature signature;
+  signature.screenHash = fnv1a(reinterpret_cast<const uint8_t*>(pixels.data()), pixels.size() * sizeof(uint32_t));
+  signature.paletteHash = fnv1a(reinterpret_cast<const uint8_t*>(palette.data()), palette.size() * sizeof(Colour));
+
+  for (int by = 0; by < SIGNATURE_BLOCKS; by++)
+  {
+    for (int bx = 0; bx < SIGNATURE_BLOCKS; bx++)
+    {
+      int x0 = bx * width / SIGNATURE_BLOCKS, x1 = (bx + 1) * width / SIGNATURE_BLOCKS;
+      int y0 = by * height / SIGNATURE_BLOCKS, y1 = (by + 1) * height / SIGNATURE_BLOCKS;
+      uint64_t total = 0;
+      for (int y = y0; y < y1; y++)
+      {
+        for (int x = x0; x < x1; x++)
+        {
+          uint32_t c = pixels[static_cast<size_t>(y) * width + x];
+          total += (77 * ((c >> 16) & 0xFF) + 150 * ((c >> 8) & 0xFF) + 29 * (c & 0xFF)) >> 8;
+        }
+      }
+      long count = static_cast<long>(x1 - x0) * (y1 - y0);
+      signature.blocks.push_back(static_cast<uint8_t>(count > 0 ? (total + count / 2) / count : 0));
+    }
+  }
+  return signature;
+}
+
+/**
+ * A presenter signing every frame it is given
+ **/
+class SigningPresenter : public Presenter
+{
+public:
+  bool open(const char*, int, int) override { return true; }
+  bool quitRequested() override { return false; }
+  void present(const Framebuffer& screen, const Palette& palette) override
+  {
+    signatures.push_back(signFrame(screen, palette));
+  }
+
+  void presentLayers(const Framebuffer& screen, const Palette& palette, const std::vector<Layer>& layers) override
+  {
+    composited.resize(screen.size());
+    compositor.composite(screen, palette, layers, reinterpret_cast<uint8_t*>(composited.data()), screen.width() * static_cast<int>(sizeof(uint32_t)));
+    signatures.push_back(signComposited(composited, screen.width(), screen.height(), palette));
+  }
+
+  std::vector<FrameSignature> signatures;
+
+private:
+  Compositor compositor;
+  std::vector<uint32_t> composited;
+};
+
+/**
+ * The scenes of effects drawn over each other tested along with the effects,
+ * one for every blend mode and one with two instances of the same effect
+ **/
+inline std::vector<std::string> layeredEffectNames()
+{
+  return {"tunnel+swscroll", "cloud_plasma+fire:add", "rotozoom+water:alpha", "rain+rain:alpha"};
+}
+
+// The golden files are named after the effects, with the characters which are not welcome in file names replaced
+inline std::string goldenName(std::string name)
+{
+  std::replace(name.begin(), name.end(), ':', '_');
+  return name;
+}
+
+/**
+ * The golden files have one line per frame: the frame number, the two hashes and
+ * the block means, in hexadecimal
+ **/
+inline bool writeGolden(const std::string& filename, const std::vector<FrameSignature>& signatures)
+{
+  std::ofstream out(filename);
+  if (!out)
+  {
+    std::cerr << "Cannot create golden file:" << filename << std::endl;
+    return false;
+  }
+
+  for (size_t i = 0; i < signatures.size(); i++)
+  {
+    out << i << std::hex << std::setfill('0')
+        << " " << std::setw(16) << signatures[i].screenHash
+        << " " << std::setw(16) << signatures[i].paletteHash << " ";
+    for (uint8_t block : signatures[i].blocks)
+    {
+      out << std::setw(2) << static_cast<int>(block);
+    }
+    out << std::dec << std::setfill(' ') << "\n";
+  }
+  return static_cast<bool>(out);
+}
+
+inline bool readGolden(const std::string& filename, std::vector<FrameSignature>& signatures)
+{
+  std::ifstream in(filename);
+  if (!in)
+  {
+    std::cerr << "Cannot open golden file:" << filename << " (create it with --update)" << std::endl;
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(in, line))
+  {
+    std::istringstream fields(line);
+    long frame;
+    std::string blocks;
+    FrameSignature signature;
+    if (!(fields >> frame >> std::hex >> signature.screenHash >> signature.paletteHash >> blocks) ||
+        blocks.size() != 2 * SIGNATURE_BLOCKS * SIGNATURE_BLOCKS)
+    {
+      std::cerr << "Invalid golden file:" << filename << std::endl;
+      return false;
+    }
+    for (size_t i = 0; i < blocks.size(); i += 2)
+    {
+      signature.blocks.push_back(static_cast<uint8_t>(std::stoi(blocks.substr(i, 2), nullptr, 16)));
+    }
+    signatures.push_back(signature);
+  }
+  return true;
+}
+
+// The largest difference between the blocks of two frames
+inline int blockDifference(const FrameSignature& a, const FrameSignature& b)
+{
+  int largest = 0;
+  for (size_t i = 0; i < a.blocks.size() && i < b.blocks.size(); i++)
+  {
+    largest = std::max(largest, std::abs(a.blocks[i] - b.blocks[i]));
+  }
+  return largest;
+}
+
+/**
+ * Runs the effect through the main loop, as the programs do, but without a
+ * window or throttling, and compares (or with --update, stores) its frames.
+ * Returns true if the effect has passed.
+ **/
+inline bool testEffect(const std::string& name, const GoldenOptions& options)
+{
+  auto effect = makeEffect(name, options.root);
+  if (!effect)
+  {
+    std::cerr << "Unknown effect: " << name << std::endl;
+    return false;
+  }
+
+  HostOptions host;
+  host.frames = options.frames;
+  host.seed = options.seed;
+  host.throttle = false;
+  host.pipeline = options.pipeline;
+
+  SigningPresenter presenter;
+  if (runEffect(*effect, presenter, host) != EXIT_SUCCESS)
+  {
+    std::cerr << "Cannot run effect: " << name << std::endl;
+    return false;
+  }
+
+  std::string filename = options.dir + "/" + goldenName(name) + ".txt";
+  std::cout << std::left << std::setw(24) << name;
+  if (options.update)
+  {
+    bool written = writeGolden(filename, presenter.signatures);
+    std::cout << (written ? "written" : "FAILED") << " (" << presenter.signatures.size() << " frames)" << std::endl;
+    return written;
+  }
+
+  std::vector<FrameSignature> golden;
+  if (!readGolden(filename, golden))
+  {
+    std::cout << "FAILED" << std::endl;
+    return false;
+  }
+
+  if (golden.size() != presenter.signatures.size())
+  {
+    std::cout << "FAILED: " << presenter.signatures.size() << " frames instead of " << golden.size() << std::endl;
+    return false;
+  }
+
+  // The frames which are not exactly the golden ones, but within the tolerance
+  int approximated = 0;
+  int largest = 0;
+  for (size_t i = 0; i < golden.size(); i++)
+  {
+    const FrameSignature& expected = golden[i];
+    const FrameSignature& actual = presenter.signatures[i];
+    if (actual.screenHash == expected.screenHash && actual.paletteHash == expected.paletteHash)
+    {
+      continue;
+    }
+
+    int difference = blockDifference(actual, expected);
+    if (options.tolerance < 0 || difference > options.tolerance)
+    {
+      std::cout << "FAILED at frame " << i << ": " << std::hex << std::setfill('0')
+                << std::setw(16) << actual.screenHash << "/" << std::setw(16) << actual.paletteHash << " instead of "
+                << std::setw(16) << expected.screenHash << "/" << std::setw(16) << expected.paletteHash
+                << std::dec << std::setfill(' ') << ", blocks differ by up to " << difference << std::endl;
+      return false;
+    }
+    approximated++;
+    largest = std::max(largest, difference);
+  }
+
+  std::cout << "ok (" << golden.size() << " frames";
+  if (approximated > 0) std::cout << ", " << approximated << " within the tolerance, blocks differ by up to " << largest;
+  std::cout << ")" << std::endl;
+  return true;
+}
+
+// The frames between the snapshots of the seeker, few so that the seeks start from different ones
+const long SEEK_INTERVAL = 4;
+
+/**
+ * Plays the first half of the frames of the effect, then seeks back and forth
+ * (forwards past the frames played, backwards to the start, between two
+ * snapshots) and compares the frame drawn after every seek with the golden
+ * file. The effects drawing their frames on their own also draw all of them
+ * with drawFrame(), from the last one back. Returns true if the effect has passed.
+ **/
+inline bool testSeeking(const std::string& name, const GoldenOptions& options)
+{
+  std::cout << std::left << std::setw(24) << name;
+  std::vector<FrameSignature> golden;
+  if (!readGolden(options.dir + "/" + goldenName(name) + ".txt", golden) || golden.size() < 8)
+  {
+    std::cout << "FAILED: no golden file to seek in" << std::endl;
+    return false;
+  }
+
+  auto effect = makeEffect(name, options.root);
+  if (!effect)
+  {
+    std::cout << "FAILED: unknown effect" << std::endl;
+    return false;
+  }
+
+  // Set up as runEffect() does, so the frames are the golden ones
+  srand(options.seed);
+  Framebuffer screen(effect->width(), effect->height());
+  effect->resize(screen);
+  if (!effect->init(screen))
+  {
+    std::cout << "FAILED: cannot initialize" << std::endl;
+    return false;
+  }
+
+  SigningPresenter presenter;
+  EffectSeeker seeker(SEEK_INTERVAL);
+  seeker.start(*effect, screen);
+
+  // Draws the next frame, and tells whether it is the golden one
+  auto drawNext = [&](long frame) {
+    effect->update(screen);
+    presentFrame(presenter, screen, effect->palette(), effect->layers());
+    screen.clearDamage();
+    seeker.advanced(*effect, screen);
+    const FrameSignature& actual = presenter.signatures.back();
+    return actual.screenHash == golden[frame].screenHash && actual.paletteHash == golden[frame].paletteHash;
+  };
+
+  const long last = static_cast<long>(golden.size()) - 1;
+  for (long frame = 0; frame <= last / 2; frame++)
+  {
+    if (!drawNext(frame))
+    {
+      std::cout << "FAILED at frame " << frame << " before seeking" << std::endl;
+      return false;
+    }
+  }
+
+  const long targets[] = {last - 1, 1, last / 2 + 2, 0, SEEK_INTERVAL + 1, last};
+  for (long target : targets)
+  {
+    if (!seeker.seek(*effect, screen, target))
+    {
+      std::cout << "FAILED: cannot seek to frame " << target << std::endl;
+      return false;
+    }
+    if (!drawNext(target))
+    {
+      std::cout << "FAILED at frame " << target << " after seeking to it" << std::endl;
+      return false;
+    }
+  }
+
+  Framebuffer drawn(screen.width(), screen.height());
+  bool drawsFrames = effect->drawFrame(drawn, 0);
+  for (long frame = last; drawsFrames && frame >= 0; frame--)
+  {
+    effect->drawFrame(drawn, frame);
+    if (signFrame(drawn, effect->palette()).screenHash != golden[frame].screenHash)
+    {
+      std::cout << "FAILED at frame " << frame << " drawn on its own" << std::endl;
+      return false;
+    }
+  }
+
+  std::cout << "ok (" << std::size(targets) << " seeks, " << seeker.keyframeCount() << " snapshots"
+            << (drawsFrames ? ", frames drawn on their own" : "") << ")" << std::endl;
+  return true;
+}
+
+// The frames drawn before the allocations are counted, for the buffers allocated on the first ones
+const long ALLOCATION_WARMUP = 8;
+
+/**
+ * Draws the frames of the effect after a few first ones and counts the
+ * allocations made meanwhile, by the effect and by the thread pool dispatching
+ * its bands. Returns true if there are none.
+ **/
+inline bool testAllocations(const std::string& name, const GoldenOptions& options)
+{
+  std::cout << std::left << std::setw(24) << name;
+  auto effect = makeEffect(name, options.root);
+  if (!effect)
+  {
+    std::cout << "FAILED: unknown effect" << std::endl;
+    return false;
+  }
+
+  srand(options.seed);
+  Framebuffer screen(effect->width(), effect->height());
+  effect->resize(screen);
+  if (!effect->init(screen))
+  {
+    std::cout << "FAILED: cannot initialize" << std::endl;
+    return false;
+  }
+
+  for (long frame = 0; frame < ALLOCATION_WARMUP; frame++)
+  {
+    effect->update(screen);
+  }
+
+  long before = allocationCount.load();
+  for (long frame = 0; frame < options.frames; frame++)
+  {
+    effect->update(screen);
+  }
+  long allocations = allocationCount.load() - before;
+
+  if (allocations > 0)
+  {
+    std::cout << "FAILED: " << allocations << " allocations in " << options.frames << " frames" << std::endl;
+    return false;
+  }
+  std::cout << "ok (" << options.frames << " frames, no allocations)" << std::endl;
+  return true;
+}
+
+inline bool parseGoldenOptions(int argc, char* argv[], GoldenOptions& options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--frames" && i + 1 < argc) options.frames = std::atol(argv[++i]);
+    else if (arg == "--seed" && i + 1 < argc) options.seed = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    else if (arg == "--root" && i + 1 < argc) options.root = argv[++i];
+    else if (arg == "--dir" && i + 1 < argc) options.dir = argv[++i];
+    else if (arg == "--tolerance" && i + 1 < argc) options.tolerance = std::atoi(argv[++i]);
+    else if (arg == "--update") options.update = true;
+    else if (arg == "--pipeline") options.pipeline = true;
+    else if (arg == "--seek") options.seek = true;
+    else if (arg == "--allocations") options.allocations = true;
+    else if (arg == "--threads" && i + 1 < argc) options.threads = std::atoi(argv[++i]);
+    else if (arg == "--effect" && i + 1 < argc) options.effects.push_back(argv[++i]);
+    else if (arg == "--tier") options.tier = true;
+    else
+    {
+      std::cerr << "Usage: " << argv[0] << " [--frames N] [--seed N] [--root DIR] [--dir DIR] [--tolerance T] [--update] [--pipeline] [--seek] [--allocations] [--threads N] [--effect NAME]... [--tier]" << std::endl;
+      std::cerr << "Effects:";
+      for (const auto& name : effectNames()) std::cerr << " " << name;
+      std::cerr << std::endl;
+      std::cerr << "Layered:";
+      for (const auto& name : layeredEffectNames()) std::cerr << " " << name;
+      std::cerr << std::endl;
+      return false;
+    }
+  }
+
+  if (options.effects.empty())
+  {
+    options.effects = effectNames();
+    for (const auto& name : layeredEffectNames()) options.effects.push_back(name);
+  }
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  GoldenOptions options;
+  if (!parseGoldenOptions(argc, argv, options))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // LXF_CPU_TIER only asks for a tier, the CPU may not have it
+  if (options.tier)
+  {
+    std::cout << cpuTierName(cpuTier()) << std::endl;
+    return EXIT_SUCCESS;
+  }
+
+  if (options.threads > 0)
+  {
+    setThreadCount(options.threads);
+  }
+
+  int failed = 0;
+  for (const auto& name : options.effects)
+  {
+    bool passed = options.allocations ? testAllocations(name, options) :
+                  options.seek ? testSeeking(name, options) : testEffect(name, options);
+    if (!passed)
+    {
+      failed++;
+    }
+  }
+
+  if (failed > 0)
+  {
+    std::cout << failed << " of " << options.effects.size() << " effects FAILED" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,30 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "custom_image.h"
+
+// Converts a .custom image, in the old text or in the binary format, to the binary format
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " input_file output_file" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    CustomImage image;
+    if (!loadCustomImage(argv[1], image)) {
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Colour> palette;
+    for (int i = 0; i < image.colourCount(); ++i) {
+        palette.push_back(image.colour(i));
+    }
+
+    if (!writeCustomImage(argv[2], image.width(), image.height(), palette, image.pixels())) {
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Image saved in custom format: " << argv[2] << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -5,6 +5,7 @@
 #include <random>
 #include <fstream>  // Include the necessary header for file operations
 #include "lodepng/lodepng.h"
+#include "custom_image.h"
 
 // Function to find the index of the closest color in the palette
 size_t findClosestColor(const std::vector<unsigned char>& color, const std::vector<std::vector<unsigned char>>& palette) {
@@ -101,8 +102,28 @@ std::vector<unsigned char> resizeImage(const std::vector<unsigned char>& origina
     return resizedImage;
 }
 
-// Function to save the image in the custom format
-void saveCustomFormat(const char* outputFilename, const std::vector<unsigned char>& resizedImage, const std::vector<std::vector<unsigned char>>& palette, unsigned targetWidth, unsigned targetHeight) {
+// Function to save the image in the custom format, binary unless the old text format is asked for
+void saveCustomFormat(const char* outputFilename, const std::vector<unsigned char>& resizedImage, const std::vector<std::vector<unsigned char>>& palette, unsigned targetWidth, unsigned targetHeight, bool text) {
+    // Find the palette entry of every pixel
+    std::vector<uint8_t> indices(static_cast<size_t>(targetWidth) * targetHeight);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        size_t index = i * 4;
+        indices[i] = static_cast<uint8_t>(findClosestColor({resizedImage[index], resizedImage[index + 1], resizedImage[index + 2], resizedImage[index + 3]}, palette));
+    }
+
+    if (!text) {
+        std::vector<Colour> colours;
+        for (const auto& color : palette) {
+            colours.push_back({color[0], color[1], color[2], color[3]});
+        }
+
+        if (!writeCustomImage(outputFilename, targetWidth, targetHeight, colours, indices.data())) {
+            return;
+        }
+        std::cout << "Image saved in custom format: " << outputFilename << std::endl;
+        return;
+    }
+
     std::ofstream outputFile(outputFilename);
 
     // Write dimensions to the file
@@ -119,18 +140,16 @@ void saveCustomFormat(const char* outputFilename, const std::vector<unsigned cha
     // Write image data to the file
     for (size_t y = 0; y < targetHeight; ++y) {
         for (size_t x = 0; x < targetWidth; ++x) {
-            size_t index = (y * targetWidth + x) * 4;
-            size_t closestIndex = findClosestColor({resizedImage[index], resizedImage[index + 1], resizedImage[index + 2], resizedImage[index + 3]}, palette);
-            outputFile << closestIndex << " ";
+            outputFile << static_cast<int>(indices[y * targetWidth + x]) << " ";
         }
         outputFile << "\n";
     }
 
-    std::cout << "Image saved in custom format: " << outputFilename << std::endl;
+    std::cout << "Image saved in text custom format: " << outputFilename << std::endl;
 }
 
 // Function to load PNG file, resize, create a reduced palette using k-means clustering, and save the new PNG file
-void resizeAndReduceColors(const char* inputFilename, const char* outputFilename, size_t targetWidth, size_t targetHeight, size_t k, size_t maxIterations) {
+void resizeAndReduceColors(const char* inputFilename, const char* outputFilename, size_t targetWidth, size_t targetHeight, size_t k, size_t maxIterations, bool text) {
     // Vector to store RGBA values for each pixel in the image
     std::vector<unsigned char> originalImage;
     unsigned originalWidth, originalHeight;
@@ -170,13 +189,14 @@ void resizeAndReduceColors(const char* inputFilename, const char* outputFilename
     }
 
     // Save the new image in custom format
-    saveCustomFormat(outputFilename, resizedImage, palette, targetWidth, targetHeight);
+    saveCustomFormat(outputFilename, resizedImage, palette, targetWidth, targetHeight, text);
 }
 
 int main(int argc, char* argv[]) {
     // Check if the correct number of command-line arguments are provided
-    if (argc != 7) {
-        std::cerr << "Usage: " << argv[0] << " input_file output_file width height colors reduction" << std::endl;
+    bool text = argc == 8 && std::string(argv[7]) == "--text";
+    if (argc != 7 && !text) {
+        std::cerr << "Usage: " << argv[0] << " input_file output_file width height colors reduction [--text]" << std::endl;
         return EXIT_FAILURE;
     }
 
@@ -189,7 +209,7 @@ int main(int argc, char* argv[]) {
     int reduction = std::stoi(argv[6]);
 
     // Call the resizeAndReduceColors function
-    resizeAndReduceColors(inputFileName, outputFileName, width, height, colors, reduction);
+    resizeAndReduceColors(inputFileName, outputFileName, width, height, colors, reduction, text);
 
     return 0;
 }
@@ -4,10 +4,10 @@
 #include <cstdlib>
 #include <ctime>
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <vector>
 
+#include "custom_image.h"
+
 const int SCREENSIZE_X = 640;
 const int SCREENSIZE_Y = 480;
 const int XMIN = 0;
@@ -35,59 +35,17 @@ void initializeScreen(Uint8* screen)
   memset(screen, 0, SCREENSIZE_X * SCREENSIZE_Y);
 }
 
-void updateScreen(Uint8* screen, const std::vector<int>& imageData, unsigned width, unsigned height) 
+void updateScreen(Uint8* screen, const CustomImage& image, unsigned width, unsigned height) 
 {
     // Copy the imageData into the screen array
     for (unsigned y = 0; y < height; ++y) {
         for (unsigned x = 0; x < width; ++x) {
-            int index = y * width + x;
-            putPixel(x, y, static_cast<Uint8>(imageData[index]), screen);
+            int index = y * image.width() + x;
+            putPixel(x, y, image.pixels()[index], screen);
         }
     }
 }
 
-// Function to split a string into a vector of integers
-std::vector<int> split(const std::string& s, char delimiter) {
-    std::vector<int> tokens;
-    std::string token;
-    std::istringstream tokenStream(s);
-    while (std::getline(tokenStream, token, delimiter)) {
-        tokens.push_back(std::stoi(token));
-    }
-    return tokens;
-}
-
-bool loadCustomImage(const std::string& filename, std::vector<int>& palette, std::vector<int>& imageData, unsigned& width, unsigned& height) {
-    std::ifstream inFile(filename);
-    if (!inFile.is_open()) {
-        std::cerr << "Error opening file for reading: " << filename << std::endl;
-        return false;
-    }
-
-    std::string imageSize;
-    std::getline(inFile, imageSize);
-    std::vector<int> sizeValues = split(imageSize, 'x');
-    width = sizeValues[0];
-    height = sizeValues[1];
-
-    palette.clear();
-    std::string colorLine;
-    while (std::getline(inFile, colorLine) && !colorLine.empty()) {
-        std::vector<int> colorValues = split(colorLine, ' ');
-        palette.insert(palette.end(), colorValues.begin(), colorValues.end());
-    }
-
-    imageData.clear();
-    std::string rowLine;
-    while (std::getline(inFile, rowLine)) {
-        std::vector<int> rowValues = split(rowLine, ' ');
-        imageData.insert(imageData.end(), rowValues.begin(), rowValues.end());
-    }
-
-    inFile.close();
-    return true;
-}
-
 int main() 
 {
     srand(static_cast<unsigned int>(time(nullptr)));
@@ -138,24 +96,26 @@ int main()
     Uint8* screen = new Uint8[SCREENSIZE_X * SCREENSIZE_Y + 1];
     initializeScreen(screen);
 
-    std::vector<int> palette;
-    std::vector<int> imageData;
-    unsigned width, height;
+    CustomImage image;
 
-    if (!loadCustomImage("output_image.custom", palette, imageData, width, height)) {
+    if (!loadCustomImage("output_image.custom", image)) {
         SDL_Quit();
         return 1;
     }
 
+    // The image is shown in the top left corner, whatever does not fit is cut off
+    unsigned width = std::min<unsigned>(image.width(), SCREENSIZE_X);
+    unsigned height = std::min<unsigned>(image.height(), SCREENSIZE_Y);
+
     SDL_Color colours[256] = {0};
-    for (size_t i = 0; i < palette.size(); i += 4) {
-        colours[i / 4].r = palette[i];
-        colours[i / 4].g = palette[i + 1];
-        colours[i / 4].b = palette[i + 2];
-        colours[i / 4].a = palette[i + 3];
+    for (int i = 0; i < image.colourCount(); i++) {
+        colours[i].r = image.colour(i).r;
+        colours[i].g = image.colour(i).g;
+        colours[i].b = image.colour(i).b;
+        colours[i].a = image.colour(i).a;
     }
 
-    SDL_SetPaletteColors(surface->format->palette, colours, 0, palette.size() / 4);
+    SDL_SetPaletteColors(surface->format->palette, colours, 0, image.colourCount());
 
     SDL_Texture* texture = nullptr;
 
@@ -175,7 +135,7 @@ int main()
             break;
         }
 
-        updateScreen(screen, imageData, width, height);
+        updateScreen(screen, image, width, height);
 
         uint8_t* offscreen = (uint8_t*)surface->pixels;
         memcpy(offscreen, screen, SCREENSIZE_X * SCREENSIZE_Y);